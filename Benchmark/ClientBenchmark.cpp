@@ -0,0 +1,268 @@
+/*
+Copyright (C) 2021 by ODDSound Ltd. info@oddsound.com
+
+Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF
+THIS SOFTWARE.
+*/
+
+/*
+ Benchmark of the client query functions that plugins call for every voice on every block. The client is built against
+ the stand-in libMTS of the tests, Tests/StandInLibMTS.h, installed with MTS_Client_SetLibraryLookup(), that publishes its
+ tables, flags and masks in process memory exactly as the reference libMTS does, so every query takes the same path as
+ with a real master but timings do not depend on an installed library.
+
+ Each query is timed in blocks of eQueriesPerBlock calls, and the time per query of each block is reported as the median
+ and 99th percentile over eNumBlocks blocks. Batch functions are timed per note. On Linux, the instructions retired per
+ query are also counted, as the median over the same blocks, if the kernel allows reading the instruction counter (see
+ /proc/sys/kernel/perf_event_paranoid); they are shown as - otherwise. Instruction counts do not depend on clock speed
+ or on other processes, so are the better measure for comparing two versions of the client. Scenarios:
+
+ offline        no master, queries read the client's local table
+ online         master connected, queries read the shared tables, which stay in cache from block to block
+ cold cache     as online, but the caches are flushed before every block, as by other plugins processing between blocks,
+                so the first queries of each block miss the cache
+ multi-channel  master connected with a multi-channel table on every MIDI channel, queried with a channel
+ tuning sweep   as online, but the master retunes one note before every block, so each block refreshes a derived table
+*/
+
+#include "libMTSClient.h"
+#include "StandInLibMTS.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// A master with a quarter-tone offset on every other note, a multi-channel table offset by a cent per channel on
+// every channel, and the top octave filtered out.
+static void connectMaster(bool multiChannel)
+{
+    stub::registerMaster();
+    stub::slot &s = stub::slots[0];
+    stub::beginWrite();
+    for (int i = 0; i < 128; i++)
+        s.tuning[i] = 440.0 * pow(2.0, (i - 69.0 + ((i & 1) ? 0.5 : 0.0)) / 12.0);
+    for (int c = 0; c < 16; c++)
+    {
+        s.multiChannelInUse[c] = multiChannel;
+        for (int i = 0; i < 128; i++)
+            s.multiChannelTunings[128 * c + i] = s.tuning[i] * pow(2.0, c / 1200.0);
+    }
+    for (int i = 0; i < 17 * 4; i++)
+        s.noteFilterMasks[i] = (i & 3) == 3 ? 0xffff0000u : 0u;
+    for (int i = 0; i < 16 * 4; i++)
+        s.multiChannelNoteFilterMasks[i] = (i & 3) == 3 ? 0xffff0000u : 0u;
+    stub::endWrite();
+}
+
+static void retune(int note)
+{
+    const stub::slot &s = stub::slots[0];
+    stub::setNoteTuning(s.tuning[note] * ((s.generation & 1) ? 1.001 : 1.0 / 1.001), note);
+}
+
+enum {eQueriesPerBlock = 64, eNumBlocks = 20000, eNumWarmupBlocks = 1000};
+
+// Flushing the caches takes far longer than a block of queries, so fewer blocks are timed with cold caches.
+enum {eNumColdBlocks = 2000, eNumColdWarmupBlocks = 100, eFlushBytes = 64 << 20};
+
+enum eScenario {eOffline, eOnline, eColdCache, eMultiChannel, eTuningSweep};
+
+static const char *scenarioNames[] = {"offline", "online", "cold cache", "multi-channel", "tuning sweep"};
+
+static volatile double sink = 0.0; // keeps results from being optimized away
+
+// Evicts the client's tables from every level of cache by writing to a buffer larger than the last level cache.
+static void flushCaches()
+{
+    static std::vector<char> buffer(eFlushBytes);
+    for (size_t i = 0; i < buffer.size(); i += 64)
+        buffer[i] = static_cast<char>(buffer[i] + 1);
+    sink = sink + buffer[0];
+}
+
+// Counts the instructions retired by the calling thread in user space, where the OS allows it.
+struct instructionCounter
+{
+    int fd;
+
+    instructionCounter() : fd(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~instructionCounter()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    bool available() const {return fd >= 0;}
+
+    long long read() const
+    {
+        long long n = 0;
+#ifdef __linux__
+        if (fd >= 0 && ::read(fd, &n, sizeof(n)) != static_cast<ssize_t>(sizeof(n)))
+            n = 0;
+#endif
+        return n;
+    }
+};
+
+static instructionCounter instructions;
+
+// Inputs for one block of queries: a spread of notes, their channels for the scenario, and frequencies a little off them.
+struct block
+{
+    char notes[eQueriesPerBlock];
+    signed char channels[eQueriesPerBlock];
+    double freqs[eQueriesPerBlock];
+
+    block(eScenario scenario)
+    {
+        for (int i = 0; i < eQueriesPerBlock; i++)
+        {
+            notes[i] = static_cast<char>(24 + (i * 37) % 80);
+            channels[i] = scenario == eMultiChannel ? static_cast<signed char>(i & 15) : static_cast<signed char>(-1);
+            freqs[i] = 440.0 * pow(2.0, (notes[i] - 69.0 + 0.2) / 12.0);
+        }
+    }
+};
+
+struct single
+{
+    const char *name;
+    double (*query)(MTSClient *client, const block &b, int i);
+};
+
+struct batch
+{
+    const char *name;
+    double (*query)(MTSClient *client, const block &b);
+};
+
+static const single singles[] =
+{
+    {"MTS_NoteToFrequency",             [](MTSClient *c, const block &b, int i) {return MTS_NoteToFrequency(c, b.notes[i], b.channels[i]);}},
+    {"MTS_RetuningInSemitones",         [](MTSClient *c, const block &b, int i) {return MTS_RetuningInSemitones(c, b.notes[i], b.channels[i]);}},
+    {"MTS_RetuningAsRatio",             [](MTSClient *c, const block &b, int i) {return MTS_RetuningAsRatio(c, b.notes[i], b.channels[i]);}},
+    {"MTS_ShouldFilterNote",            [](MTSClient *c, const block &b, int i) {return MTS_ShouldFilterNote(c, b.notes[i], b.channels[i]) ? 1.0 : 0.0;}},
+    {"MTS_FrequencyToNote",             [](MTSClient *c, const block &b, int i) {return static_cast<double>(MTS_FrequencyToNote(c, b.freqs[i], b.channels[i]));}},
+    {"MTS_FrequencyToNoteAndChannel",   [](MTSClient *c, const block &b, int i) {signed char ch; return static_cast<double>(MTS_FrequencyToNoteAndChannel(c, b.freqs[i], &ch) + ch);}},
+    {"MTS_KeyToFrequency",              [](MTSClient *c, const block &b, int i) {return MTS_KeyToFrequency(c, ((b.channels[i] & 15) << 7) | b.notes[i]);}},
+};
+
+static const batch batches[] =
+{
+    {"MTS_NoteToFrequencies",           [](MTSClient *c, const block &b) {double r[eQueriesPerBlock]; MTS_NoteToFrequencies(c, b.notes, b.channels, r, eQueriesPerBlock); return r[0];}},
+    {"MTS_RetuningsInSemitones",        [](MTSClient *c, const block &b) {double r[eQueriesPerBlock]; MTS_RetuningsInSemitones(c, b.notes, b.channels, r, eQueriesPerBlock); return r[0];}},
+    {"MTS_RetuningsInSemitonesFloat",   [](MTSClient *c, const block &b) {float r[eQueriesPerBlock]; MTS_RetuningsInSemitonesFloat(c, b.notes, b.channels, r, eQueriesPerBlock); return static_cast<double>(r[0]);}},
+};
+
+// Times a number of blocks after a warm-up, calling runBlock for each, and prints the time per query of the median and
+// 99th percentile block, and the instructions per query of the median block.
+template <typename F>
+static void measure(eScenario scenario, const char *name, F runBlock)
+{
+    typedef std::chrono::steady_clock clock;
+    const int numBlocks = scenario == eColdCache ? static_cast<int>(eNumColdBlocks) : static_cast<int>(eNumBlocks);
+    const int numWarmupBlocks = scenario == eColdCache ? static_cast<int>(eNumColdWarmupBlocks) : static_cast<int>(eNumWarmupBlocks);
+    std::vector<double> nsPerQuery(numBlocks);
+    std::vector<double> instructionsPerQuery(numBlocks);
+
+    for (int b = -numWarmupBlocks; b < numBlocks; b++)
+    {
+        if (scenario == eTuningSweep)
+            retune(24 + ((b & 0x7fffffff) * 37) % 80);
+        else if (scenario == eColdCache)
+            flushCaches();
+
+        long long startInstructions = instructions.read();
+        clock::time_point start = clock::now();
+        runBlock();
+        clock::time_point end = clock::now();
+        long long endInstructions = instructions.read();
+
+        if (b >= 0)
+        {
+            nsPerQuery[b] = std::chrono::duration<double, std::nano>(end - start).count() / eQueriesPerBlock;
+            instructionsPerQuery[b] = static_cast<double>(endInstructions - startInstructions) / eQueriesPerBlock;
+        }
+    }
+
+    std::sort(nsPerQuery.begin(), nsPerQuery.end());
+    std::sort(instructionsPerQuery.begin(), instructionsPerQuery.end());
+    printf("%-15s %-32s %9.1f %9.1f", scenarioNames[scenario], name, nsPerQuery[numBlocks / 2], nsPerQuery[numBlocks * 99 / 100]);
+    if (instructions.available())
+        printf(" %9.1f\n", instructionsPerQuery[numBlocks / 2]);
+    else
+        printf(" %9s\n", "-");
+}
+
+int main()
+{
+    if (!MTS_Client_SetLibraryLookup(stub::lookup))
+    {
+        fprintf(stderr, "libMTS was opened before the stand-in could be installed\n");
+        return 1;
+    }
+
+    printf("ns per query, median and 99th percentile of %d blocks of %d queries (%d with cold caches), and instructions per\n", eNumBlocks, eQueriesPerBlock, eNumColdBlocks);
+    printf("query of the median block\n\n");
+    printf("%-15s %-32s %9s %9s %9s\n", "scenario", "function", "p50", "p99", "instr");
+
+    for (int s = eOffline; s <= eTuningSweep; s++)
+    {
+        eScenario scenario = static_cast<eScenario>(s);
+        if (scenario == eOffline)
+            stub::deregisterMaster();
+        else
+            connectMaster(scenario == eMultiChannel);
+
+        block b(scenario);
+
+        for (size_t i = 0; i < sizeof(singles) / sizeof(singles[0]); i++)
+        {
+            MTSClient *client = MTS_RegisterClient(); // a new client for each function, so none is affected by another's queries
+            const single &q = singles[i];
+            measure(scenario, q.name, [&]() {
+                double sum = 0.0;
+                for (int j = 0; j < eQueriesPerBlock; j++)
+                    sum += q.query(client, b, j);
+                sink = sink + sum;
+            });
+            MTS_DeregisterClient(client);
+        }
+
+        for (size_t i = 0; i < sizeof(batches) / sizeof(batches[0]); i++)
+        {
+            MTSClient *client = MTS_RegisterClient();
+            const batch &q = batches[i];
+            measure(scenario, q.name, [&]() {sink = sink + q.query(client, b);});
+            MTS_DeregisterClient(client);
+        }
+    }
+
+    return 0;
+}
@@ -9,6 +9,9 @@ THIS SOFTWARE.
 
 #include "libMTSClient.h"
 #include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__) || defined(__TOS_WIN__) || defined(_MSC_VER)
 #define MTS_ESP_WIN
 #define WIN32_LEAN_AND_MEAN
@@ -17,12 +20,15 @@ typedef HRESULT (WINAPI* SHGetKnownFolderPathFunc) (const GUID*, DWORD, HANDLE,
 typedef void (WINAPI* CoTaskMemFreeFunc) (LPVOID);
 #else
 #include <dlfcn.h>
+#include <stdlib.h>
+#include <unistd.h>
 #endif
 
 const static int libMTSVersion = 0x00010003;
 
 const static double ln2 = 0.693147180559945309417;
 const static double ratioToSemitones = 17.31234049066756088832; // 12.0 / log(2.0)
+const static double semitonesToCentsQ16 = 100.0 * 65536.0;
 
 typedef void (*mts_void__void)(void);
 typedef bool (*mts_bool__void)(void);
@@ -34,8 +40,538 @@ typedef bool (*mts_bool__schar)(signed char);
 typedef const char *(*mts_pConstChar__void)(void);
 typedef double (*mts_double__void)(void);
 typedef signed char (*mts_schar__void)(void);
+typedef unsigned int (*mts_uint__void)(void);
+typedef const volatile unsigned int *(*mts_pConstVolatileUInt__void)(void);
+typedef unsigned int (*mts_uint__uint_int)(unsigned int, int);
+typedef int (*mts_int__uint_pUInt_pChar_pSChar_pDouble_int)(unsigned int, unsigned int*, char*, signed char*, double*, int);
+typedef unsigned int *(*mts_pUInt__void)(void);
+typedef void (*mts_void__pUInt)(unsigned int*);
+typedef int (*mts_int__double_int_pInt_pChar_pSChar_pDouble_int)(double, int, int*, char*, signed char*, double*, int);
+typedef const double *(*mts_pConstDouble__int)(int);
+typedef const double *(*mts_pConstDouble__int_schar)(int, signed char);
+typedef bool (*mts_bool__int_schar)(int, signed char);
+typedef const char *(*mts_pConstChar__int)(int);
+typedef double (*mts_double__int)(int);
+typedef signed char (*mts_schar__int)(int);
+typedef unsigned int (*mts_uint__int)(int);
+typedef const volatile unsigned int *(*mts_pConstVolatileUInt__int)(int);
+typedef unsigned int (*mts_uint__int_uint_int)(int, unsigned int, int);
+typedef int (*mts_int__int_uint_pUInt_pChar_pSChar_pDouble_int)(int, unsigned int, unsigned int*, char*, signed char*, double*, int);
+typedef int (*mts_int__int_double_int_pInt_pChar_pSChar_pDouble_int)(int, double, int, int*, char*, signed char*, double*, int);
 
-struct mtsclientglobal
+struct mtsclientslot;
+
+// Snapshot of a tuning table with ratio and semitone retuning precomputed for every note, so that queries are a
+// single indexed load. Rebuilt in one pass whenever the source table changes. Single-precision and fixed-point copies
+// are stored alongside, so that engines working in those formats can load them directly without conversion.
+// Tables shared between clients are rebuilt by one thread at a time under a sequence lock and read with read(), which
+// fails rather than return an entry from a table being rebuilt or no longer matching its source.
+struct mtstuningtable
+{
+    mtstuningtable() : sequence(0) {}
+    
+    double freq[128];
+    double ratio[128];
+    double semitones[128];
+    float freqFloat[128];
+    float ratioFloat[128];
+    float semitonesFloat[128];
+    int centsQ16[128]; // retuning in cents, Q16.16 fixed point
+    
+    // Odd whilst update() is rebuilding the table, incremented again once it has finished.
+    std::atomic<unsigned int> sequence;
+    
+    void set(const double *freqs);
+    bool update(const double *sharedFreqs, const mtsclientslot &slot);
+    void reset();
+    
+    // The entry a table would hold for a note with frequency f, computed without the table.
+    static double entry(const double (mtstuningtable::*table)[128], int note, double f);
+    static float entry(const float (mtstuningtable::*table)[128], int note, double f);
+    static int entry(const int (mtstuningtable::*table)[128], int note, double f);
+    
+    // Reads one entry, returning false if the table is being rebuilt or its frequency for the note is not sourceFreq.
+    template <typename T>
+    inline bool read(const T (mtstuningtable::*table)[128], int note, double sourceFreq, T &value) const
+    {
+        unsigned int s = sequence.load(std::memory_order_acquire);
+        if (s & 1)
+            return false;
+        bool current = freq[note] == sourceFreq;
+        value = (this->*table)[note];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return current && sequence.load(std::memory_order_relaxed) == s;
+    }
+    
+    // As above, but accepts the entry whatever the table was last built from.
+    template <typename T>
+    inline bool read(const T (mtstuningtable::*table)[128], int note, T &value) const
+    {
+        return read(table, note, freq[note], value);
+    }
+    
+    // Copies the frequencies of all 128 notes, returning false if the table was being rebuilt during the copy.
+    inline bool readFreqs(double *dst) const
+    {
+        unsigned int s = sequence.load(std::memory_order_acquire);
+        if (s & 1)
+            return false;
+        for (int i = 0; i < 128; i++)
+            dst[i] = freq[i];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return sequence.load(std::memory_order_relaxed) == s;
+    }
+    
+private:
+    mtstuningtable(const mtstuningtable&);
+    mtstuningtable &operator=(const mtstuningtable&);
+};
+
+// Sorted index of mapped notes used to find the note nearest a frequency with a binary search. Entries sharing a
+// frequency form a group, and adjacent groups are separated by their geometric mean, computed once when the index is built.
+struct mtsnoteindex
+{
+    struct Entry
+    {
+        double freq;
+        short key; // (channel << 7) | note
+        bool operator<(const Entry &other) const {return freq < other.freq || (freq == other.freq && key < other.key);}
+    };
+    
+    explicit mtsnoteindex(int capacity)
+    : entries(new Entry[capacity])
+    , groups(new int[capacity + 1])
+    , boundaries(new double[capacity])
+    , size(0)
+    , numGroups(0)
+    , numTables(0)
+    , generation(0)
+    , valid(false)
+    {
+    }
+    
+    ~mtsnoteindex()
+    {
+        delete[] entries;
+        delete[] groups;
+        delete[] boundaries;
+    }
+    
+    void clear() {size = 0; numGroups = 0; numTables = 0;}
+    
+    inline void add(double freq, int channel, int note)
+    {
+        entries[size].freq = freq;
+        entries[size].key = static_cast<short>((channel << 7) | note);
+        size++;
+    }
+    
+    // Sorts entries by frequency then key, so the first entry of each group is the one a linear search would have found.
+    void finish(unsigned int gen)
+    {
+        std::sort(entries, entries + size);
+        numGroups = 0;
+        for (int i = 0; i < size; i++)
+            if (i == 0 || entries[i].freq != entries[i - 1].freq)
+                groups[numGroups++] = i;
+        groups[numGroups] = size;
+        for (int i = 0; i + 1 < numGroups; i++)
+            boundaries[i] = sqrt(entries[groups[i]].freq * entries[groups[i + 1]].freq);
+        generation = gen;
+        valid = true;
+    }
+    
+    inline int nearestGroup(double freq) const {return static_cast<int>(std::upper_bound(boundaries, boundaries + numGroups - 1, freq) - boundaries);}
+    
+    // Returns the key of the entry nearest freq, or 0 if the index is empty.
+    inline int find(double freq) const
+    {
+        if (size == 0)
+            return 0;
+        return entries[groups[nearestGroup(freq)]].key;
+    }
+    
+    // As find(), but skips entries whose key is set in the used bitmask, then sets the bit for the returned key.
+    // If every entry is in use the nearest entry is returned.
+    inline int findUnused(double freq, unsigned int *used) const
+    {
+        if (size == 0)
+            return 0;
+        
+        int nearest = nearestGroup(freq);
+        int lower = nearest;
+        int upper = nearest + 1;
+        int found = groups[nearest];
+        int lowerEntry = -1;
+        int upperEntry = -1;
+        
+        while (lower >= 0 || upper < numGroups)
+        {
+            if (lower >= 0 && lowerEntry < 0 && (lowerEntry = unusedInGroup(lower, used)) < 0)
+            {
+                lower--;
+                continue;
+            }
+            if (upper < numGroups && upperEntry < 0 && (upperEntry = unusedInGroup(upper, used)) < 0)
+            {
+                upper++;
+                continue;
+            }
+            if (lower < 0)
+                found = upperEntry;
+            else if (upper >= numGroups)
+                found = lowerEntry;
+            else
+                found = freq * freq < entries[lowerEntry].freq * entries[upperEntry].freq ? lowerEntry : upperEntry;
+            break;
+        }
+        
+        int key = entries[found].key;
+        used[key >> 5] |= 1u << (key & 31);
+        return key;
+    }
+    
+    inline int unusedInGroup(int group, const unsigned int *used) const
+    {
+        for (int i = groups[group]; i < groups[group + 1]; i++)
+            if (!((used[entries[i].key >> 5] >> (entries[i].key & 31)) & 1))
+                return i;
+        return -1;
+    }
+    
+    Entry *entries;
+    int *groups; // index of the first entry of each group, followed by size
+    double *boundaries;
+    int size;
+    int numGroups;
+    int numTables;
+    unsigned int generation;
+    bool valid;
+};
+
+// Output note and 14 bit pitch bend for each note, for one MIDI channel argument, built from a snapshot of the tuning
+// whenever it changes so that converting a note for MIDI output is a table lookup.
+struct mtspitchbendtable
+{
+    mtspitchbendtable() : generation(0), valid(false) {}
+    
+    void build(const double *freqs, double bendRange)
+    {
+        for (int i = 0; i < 128; i++)
+            convert(freqs[i], i, bendRange, note[i], bend[i]);
+    }
+    
+    // Converts the frequency of one note, leaving a note whose frequency is not positive untuned.
+    static void convert(double freq, int midinote, double bendRange, char &outNote, short &outBend)
+    {
+        double pitch = freq > 0.0 ? 69.0 + ratioToSemitones * log(freq / 440.0) : static_cast<double>(midinote);
+        if (!(pitch > -0.5)) // also catches NaN
+            pitch = -0.5;
+        else if (pitch > 127.5)
+            pitch = 127.5;
+        
+        int n = static_cast<int>(floor(pitch + 0.5));
+        if (n > 127)
+            n = 127;
+        double bendValue = floor(8192.0 + 8192.0 * (pitch - n) / bendRange + 0.5);
+        
+        outNote = static_cast<char>(n);
+        outBend = static_cast<short>(bendValue < 0.0 ? 0.0 : (bendValue > 16383.0 ? 16383.0 : bendValue));
+    }
+    
+    char note[128];
+    short bend[128];
+    unsigned int generation;
+    bool valid;
+};
+
+// Frequency of every note on every MIDI channel as seen by one client, indexed by the flat key (midichannel << 7) | midinote,
+// in one block aligned to a cache line, so that the keys of a controller with more than 128 keys are adjacent in memory.
+struct mtskeytable
+{
+    enum {eNumKeys = 16 * 128, eAlignment = 64};
+    
+    mtskeytable() : generation(0), valid(false)
+    {
+        uintptr_t p = reinterpret_cast<uintptr_t>(storage);
+        freq = reinterpret_cast<double*>((p + eAlignment - 1) & ~static_cast<uintptr_t>(eAlignment - 1));
+    }
+    
+    double *freq; // within storage
+    unsigned int generation;
+    bool valid;
+    
+private:
+    double storage[eNumKeys + eAlignment / sizeof(double)];
+    
+    mtskeytable(const mtskeytable&);
+    mtskeytable &operator=(const mtskeytable&);
+};
+
+// Opens libMTS the first time a client or master needs it, rather than whilst the host is loading or scanning the plugin, and
+// keeps it open until the plugin is unloaded. Defined identically in libMTSClient.cpp and libMTSMaster.cpp and with only inline
+// members, so a binary built with both shares one instance and opens libMTS once. The two definitions must be kept in step.
+// The MTS_ESP_LIBRARY_PATH environment variable names a library to try before the installed one, and a lookup function set
+// before first use replaces libMTS altogether, e.g. with stubs for testing.
+struct mtslibrary
+{
+    typedef void *(*symbollookup)(const char *name);
+    
+    static const mtslibrary &get()
+    {
+        static const mtslibrary library(pendingLookup()); // opened by whichever thread gets here first, others wait for it
+        return library;
+    }
+    
+    // Must be called before any client registers or master function is called, fails once libMTS has been opened.
+    static bool setLookup(symbollookup lookup)
+    {
+        if (opened())
+            return false;
+        pendingLookup() = lookup;
+        return true;
+    }
+    
+    bool isOpen() const {return lookup || handle;}
+    
+#ifdef MTS_ESP_WIN
+    void *symbol(const char *name) const
+    {
+        if (lookup)
+            return lookup(name);
+        return handle ? reinterpret_cast<void*>(GetProcAddress(handle, name)) : 0;
+    }
+    
+private:
+    explicit mtslibrary(symbollookup symbolLookup) : handle(0), lookup(symbolLookup)
+    {
+        opened() = true;
+        if (lookup)
+            return;
+        
+        WCHAR path[MAX_PATH];
+        DWORD pathLen = GetEnvironmentVariableW(L"MTS_ESP_LIBRARY_PATH", path, MAX_PATH);
+        if (pathLen > 0 && pathLen < MAX_PATH && (handle = LoadLibraryW(path)))
+            return;
+        
+        SHGetKnownFolderPathFunc SHGetKnownFolderPath = 0;
+        CoTaskMemFreeFunc CoTaskMemFree = 0;
+        
+        HMODULE shell32Module = GetModuleHandleW(L"Shell32.dll");
+        HMODULE ole32Module = GetModuleHandleW(L"Ole32.dll");
+        
+        if (shell32Module)
+            SHGetKnownFolderPath = (SHGetKnownFolderPathFunc)GetProcAddress(shell32Module, "SHGetKnownFolderPath");
+        
+        if (ole32Module)
+            CoTaskMemFree = (CoTaskMemFreeFunc)GetProcAddress(ole32Module, "CoTaskMemFree");
+        
+        if (!SHGetKnownFolderPath || !CoTaskMemFree)
+            return;
+        
+        const GUID FOLDERID_ProgramFilesCommonGUID = {0xF7F1ED05, 0x9F6D, 0x47A2, 0xAA, 0xAE, 0x29, 0xD3, 0x17, 0xC6, 0xF0, 0x66};
+        PWSTR cf = NULL;
+        if (SHGetKnownFolderPath(&FOLDERID_ProgramFilesCommonGUID, 0, 0, &cf) >= 0)
+        {
+            WCHAR buffer[MAX_PATH];
+            buffer[0] = L'\0';
+            if (cf)
+                wcsncpy(buffer, cf, MAX_PATH);
+            CoTaskMemFree(cf);
+            buffer[MAX_PATH - 1] = L'\0';
+            const WCHAR *libpath = L"\\MTS-ESP\\LIBMTS.dll";
+            DWORD cfLen = wcslen(buffer);
+            wcsncat(buffer, libpath, MAX_PATH - cfLen - 1);
+            handle = LoadLibraryW(buffer);
+        }
+        else
+        {
+            CoTaskMemFree(cf);
+        }
+    }
+    
+    ~mtslibrary()
+    {
+        if (handle)
+            FreeLibrary(handle);
+    }
+    
+    HINSTANCE handle;
+#else
+    void *symbol(const char *name) const
+    {
+        if (lookup)
+            return lookup(name);
+        return handle ? dlsym(handle, name) : 0;
+    }
+    
+private:
+    explicit mtslibrary(symbollookup symbolLookup) : handle(0), lookup(symbolLookup)
+    {
+        opened() = true;
+        if (lookup)
+            return;
+        
+        const char *path = getenv("MTS_ESP_LIBRARY_PATH");
+        if (path && *path && (handle = dlopen(path, RTLD_NOW)))
+            return;
+        
+        if (!(handle = dlopen("/Library/Application Support/MTS-ESP/libMTS.dylib", RTLD_NOW)))
+            handle = dlopen("/usr/local/lib/libMTS.so", RTLD_NOW);
+    }
+    
+    ~mtslibrary()
+    {
+        if (handle)
+            dlclose(handle);
+    }
+    
+    void *handle;
+#endif
+    
+    static symbollookup &pendingLookup() {static symbollookup pending = 0; return pending;}
+    static bool &opened() {static bool value = false; return value;}
+    
+    symbollookup lookup;
+    
+    mtslibrary(const mtslibrary&);
+    mtslibrary &operator=(const mtslibrary&);
+};
+
+// The tables, flags and masks of one tuning slot in libMTS, resolved once when the first client binds to the slot and
+// shared by every client in the process bound to it. Queries then read them directly, exactly as for slot 0.
+struct mtsclientslot
+{
+    explicit mtsclientslot(int slotIndex)
+    : index(slotIndex)
+    , esp_retuning(0)
+    , multi_channel_tunings(0)
+    , tuning_sequence(0)
+    , has_master_flag(0)
+    , note_filter_masks(0)
+    , multi_channel_note_filter_masks(0)
+    {
+        for (int i = 0; i < 16; i++)
+            multi_channel_esp_retuning[i] = 0;
+        
+        globalTunings.reset();
+        for (int i = 0; i < 16; i++)
+            globalMultichannelTunings[i].reset();
+    }
+    
+    bool bind();
+    
+    // Reads the connection flag published by libMTS directly where supported, avoiding a call into libMTS on every query.
+    inline bool isOnline() const;
+    
+    // Calls into libMTS for this slot. Slot 0 uses the original functions, so that it works with older versions of libMTS.
+    inline bool useMultiChannelTuning(signed char midichannel) const;
+    inline unsigned int getTuningGeneration() const;
+    inline unsigned int waitForTuningChange(unsigned int lastGeneration, int timeoutMs) const;
+    inline int getTuningChanges(unsigned int sinceGeneration, unsigned int *currentGeneration, char *midinotes, signed char *midichannels, double *freqs, int maxChanges) const;
+    inline int getScheduledTuningChanges(double blockStart, int blockLength, int *offsets, char *midinotes, signed char *midichannels, double *freqs, int maxChanges) const;
+    inline const char *getScaleName() const;
+    inline double getPeriodRatio() const;
+    inline signed char getMapSize() const;
+    inline signed char getMapStartKey() const;
+    inline signed char getRefKey() const;
+    
+    int index;
+    
+    // tuning tables
+    const double *esp_retuning;
+    const double *multi_channel_esp_retuning[16];
+    const double *multi_channel_tunings; // all 16 multi-channel tables as one block, if published by libMTS
+    
+    // Sequence lock published by libMTS: odd whilst the master is writing, incremented again once it has finished.
+    const volatile unsigned int *tuning_sequence;
+    
+    // Non-zero whilst a master is registered, written by libMTS when a master registers, deregisters or on reinitialization.
+    const volatile unsigned int *has_master_flag;
+    
+    // Note filters published by libMTS as masks of four 32 bit words, bit (note & 31) of word (note >> 5). Masks 0-15 are
+    // for each MIDI channel and mask 16 for no channel; multi-channel masks are one per multi-channel table.
+    const volatile unsigned int *note_filter_masks;
+    const volatile unsigned int *multi_channel_note_filter_masks;
+    
+    static inline bool testNoteMask(const volatile unsigned int *mask, int note) {return (mask[note >> 5] >> (note & 31)) & 1;}
+    
+    // Equivalent to ShouldFilterNote() and ShouldFilterNoteMultiChannel(), but a bit test where libMTS publishes its masks.
+    inline bool filterNote(int note, signed char midichannel) const;
+    inline bool filterNoteMultiChannel(int note, signed char midichannel) const;
+    
+    enum {eMaxSnapshotAttempts = 8};
+    
+    // Copies a shared tuning table or filter mask into dst, retrying if the master writes to it during the copy. Returns false
+    // if no consistent copy could be made within a bounded number of attempts, so never waits on the master.
+    template <typename T, typename S>
+    inline bool readTable(T *dst, const S *src, int size = 128) const
+    {
+        if (!tuning_sequence)
+        {
+            for (int i = 0; i < size; i++)
+                dst[i] = src[i];
+            return true;
+        }
+        
+        for (int attempt = 0; attempt < eMaxSnapshotAttempts; attempt++)
+        {
+            unsigned int sequence = *tuning_sequence;
+            if (sequence & 1)
+                continue;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            for (int i = 0; i < size; i++)
+                dst[i] = src[i];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (*tuning_sequence == sequence)
+                return true;
+        }
+        return false;
+    }
+    
+    // As readTable(), but copies several tables one after another into dst under a single read of the sequence lock, so
+    // that they are consistent with each other.
+    inline bool readTables(double *dst, const double *const *srcs, int numTables) const
+    {
+        for (int attempt = 0; attempt < eMaxSnapshotAttempts; attempt++)
+        {
+            unsigned int sequence = tuning_sequence ? *tuning_sequence : 0;
+            if (sequence & 1)
+                continue;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            for (int i = 0; i < numTables; i++)
+                for (int j = 0; j < 128; j++)
+                    dst[i * 128 + j] = srcs[i][j];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (!tuning_sequence || *tuning_sequence == sequence)
+                return true;
+        }
+        return false;
+    }
+    
+    // Derived from the tables above and identical for every client, so shared by all clients in the process.
+    mtstuningtable globalTunings;
+    mtstuningtable globalMultichannelTunings[16];
+};
+
+// 12-TET frequencies and their inverses. A base of mtsclientglobal, so that they are filled before its default slot resets
+// the tables derived from them.
+struct mtsequaltemperament
+{
+    mtsequaltemperament()
+    {
+        for (int i = 0; i < 128; i++)
+        {
+            et[i] = 440.0 * pow(2.0, (i - 69.0) / 12.0);
+            iet[i] = 1. / et[i];
+        }
+    }
+    
+    double et[128];
+    double iet[128];
+};
+
+struct mtsclientglobal : mtsequaltemperament
 {
     mtsclientglobal() 
     : RegisterClient(0)
@@ -52,22 +588,48 @@ struct mtsclientglobal
     , GetMapSize(0)
     , GetMapStartKey(0)
     , GetRefKey(0)
-    , esp_retuning(0)
-    , handle(0)
+    , GetTuningGeneration(0)
+    , GetTuningSequence(0)
+    , GetHasMasterFlag(0)
+    , WaitForTuningChange(0)
+    , GetTuningChanges(0)
+    , GetDiagnosticsFlag(0)
+    , AcquireDiagnostics(0)
+    , ReleaseDiagnostics(0)
+    , GetNoteFilterMasks(0)
+    , GetMultiChannelNoteFilterMasks(0)
+    , GetScheduledTuningChanges(0)
+    , GetMultiChannelTuningTables(0)
+    , SlotGetTuningTable(0)
+    , SlotGetMultiChannelTuningTable(0)
+    , SlotUseMultiChannelTuning(0)
+    , SlotGetScaleName(0)
+    , SlotGetPeriodRatio(0)
+    , SlotGetMapSize(0)
+    , SlotGetMapStartKey(0)
+    , SlotGetRefKey(0)
+    , SlotGetTuningGeneration(0)
+    , SlotGetTuningSequence(0)
+    , SlotGetHasMasterFlag(0)
+    , SlotWaitForTuningChange(0)
+    , SlotGetTuningChanges(0)
+    , SlotGetScheduledTuningChanges(0)
+    , SlotGetNoteFilterMasks(0)
+    , SlotGetMultiChannelNoteFilterMasks(0)
+    , SlotGetMultiChannelTuningTables(0)
+    , diagnostics_flag(0)
+    , defaultSlot(0)
     {
-        for (int i = 0; i < 128; i++)
-            iet[i] = 1. / (440.0 * pow(2.0, (i - 69.0) / 12.0));
-        
-        load_lib();
-        
-        if (GetTuning)
-            esp_retuning = GetTuning();
-        
-        for (int i = 0; i < 16; i++)
-            multi_channel_esp_retuning[i] = GetMultiChannelTuning ? GetMultiChannelTuning(static_cast<signed char>(i)) : 0;
+        slots[0] = &defaultSlot;
+        for (int i = 1; i < eNumSlots; i++)
+            slots[i] = 0;
     }
     
-    inline bool isOnline() const {return esp_retuning && HasMaster && HasMaster();}
+    ~mtsclientglobal()
+    {
+        for (int i = 1; i < eNumSlots; i++)
+            delete slots[i].load();
+    }
     
     // interface to lib
     mts_void__void RegisterClient;
@@ -84,130 +646,338 @@ struct mtsclientglobal
     mts_schar__void GetMapSize;
     mts_schar__void GetMapStartKey;
     mts_schar__void GetRefKey;
+    mts_uint__void GetTuningGeneration;
+    mts_pConstVolatileUInt__void GetTuningSequence;
+    mts_pConstVolatileUInt__void GetHasMasterFlag;
+    mts_uint__uint_int WaitForTuningChange;
+    mts_int__uint_pUInt_pChar_pSChar_pDouble_int GetTuningChanges;
+    mts_pConstVolatileUInt__void GetDiagnosticsFlag;
+    mts_pUInt__void AcquireDiagnostics;
+    mts_void__pUInt ReleaseDiagnostics;
+    mts_pConstVolatileUInt__void GetNoteFilterMasks;
+    mts_pConstVolatileUInt__void GetMultiChannelNoteFilterMasks;
+    mts_int__double_int_pInt_pChar_pSChar_pDouble_int GetScheduledTuningChanges;
+    mts_pConstDouble__void GetMultiChannelTuningTables;
+    mts_pConstDouble__int SlotGetTuningTable;
+    mts_pConstDouble__int_schar SlotGetMultiChannelTuningTable;
+    mts_bool__int_schar SlotUseMultiChannelTuning;
+    mts_pConstChar__int SlotGetScaleName;
+    mts_double__int SlotGetPeriodRatio;
+    mts_schar__int SlotGetMapSize;
+    mts_schar__int SlotGetMapStartKey;
+    mts_schar__int SlotGetRefKey;
+    mts_uint__int SlotGetTuningGeneration;
+    mts_pConstVolatileUInt__int SlotGetTuningSequence;
+    mts_pConstVolatileUInt__int SlotGetHasMasterFlag;
+    mts_uint__int_uint_int SlotWaitForTuningChange;
+    mts_int__int_uint_pUInt_pChar_pSChar_pDouble_int SlotGetTuningChanges;
+    mts_int__int_double_int_pInt_pChar_pSChar_pDouble_int SlotGetScheduledTuningChanges;
+    mts_pConstVolatileUInt__int SlotGetNoteFilterMasks;
+    mts_pConstVolatileUInt__int SlotGetMultiChannelNoteFilterMasks;
+    mts_pConstDouble__int SlotGetMultiChannelTuningTables;
     
-    // tuning tables
-    double iet[128];
-    const double *esp_retuning;
-    const double *multi_channel_esp_retuning[16];
+    // Non-zero whilst the master wants clients to count their queries, see MTSClient::count().
+    const volatile unsigned int *diagnostics_flag;
     
-#ifdef MTS_ESP_WIN
-    void load_lib()
+    // Slot 0 is bound when libMTS is loaded, other slots when a client first binds to them. Never freed before exit, as
+    // clients read them without locking.
+    enum {eNumSlots = 16};
+    
+    mtsclientslot defaultSlot;
+    std::atomic<mtsclientslot*> slots[eNumSlots];
+    
+    mtsclientslot *slot(int index);
+    
+    // Resolves the functions used by clients when the first client registers. Safe to call from several threads at once.
+    void load()
     {
-        SHGetKnownFolderPathFunc SHGetKnownFolderPath = 0;
-        CoTaskMemFreeFunc CoTaskMemFree = 0;
+        static const bool loaded = load_lib();
+        (void)loaded;
+    }
+    
+    bool load_lib()
+    {
+        const mtslibrary &lib = mtslibrary::get();
+        if (!lib.isOpen())
+            return false;
         
-        HMODULE shell32Module = GetModuleHandleW(L"Shell32.dll");
-        HMODULE ole32Module = GetModuleHandleW(L"Ole32.dll");
+        RegisterClient                  = (mts_void__void)          lib.symbol("MTS_RegisterClient");
+        DeregisterClient                = (mts_void__void)          lib.symbol("MTS_DeregisterClient");
+        HasMaster                       = (mts_bool__void)          lib.symbol("MTS_HasMaster");
+        GetVersionNumber                = (mts_int__void)           lib.symbol("MTS_GetVersionNumber");
+        ShouldFilterNote                = (mts_bool__char_schar)    lib.symbol("MTS_ShouldFilterNote");
+        ShouldFilterNoteMultiChannel    = (mts_bool__char_schar)    lib.symbol("MTS_ShouldFilterNoteMultiChannel");
+        GetTuning                       = (mts_pConstDouble__void)  lib.symbol("MTS_GetTuningTable");
+        GetMultiChannelTuning           = (mts_pConstDouble__schar) lib.symbol("MTS_GetMultiChannelTuningTable");
+        UseMultiChannelTuning           = (mts_bool__schar)         lib.symbol("MTS_UseMultiChannelTuning");
+        GetScaleName                    = (mts_pConstChar__void)    lib.symbol("MTS_GetScaleName");
+        GetPeriodRatio                  = (mts_double__void)        lib.symbol("MTS_GetPeriodRatio");
+        GetMapSize                      = (mts_schar__void)         lib.symbol("MTS_GetMapSize");
+        GetMapStartKey                  = (mts_schar__void)         lib.symbol("MTS_GetMapStartKey");
+        GetRefKey                       = (mts_schar__void)         lib.symbol("MTS_GetRefKey");
+        GetTuningGeneration             = (mts_uint__void)          lib.symbol("MTS_GetTuningGeneration");
+        GetTuningSequence               = (mts_pConstVolatileUInt__void) lib.symbol("MTS_GetTuningSequence");
+        GetHasMasterFlag                = (mts_pConstVolatileUInt__void) lib.symbol("MTS_GetHasMasterFlag");
+        WaitForTuningChange             = (mts_uint__uint_int)      lib.symbol("MTS_WaitForTuningChange");
+        GetTuningChanges                = (mts_int__uint_pUInt_pChar_pSChar_pDouble_int) lib.symbol("MTS_GetTuningChanges");
+        GetDiagnosticsFlag              = (mts_pConstVolatileUInt__void) lib.symbol("MTS_GetDiagnosticsFlag");
+        AcquireDiagnostics              = (mts_pUInt__void)         lib.symbol("MTS_AcquireDiagnostics");
+        ReleaseDiagnostics              = (mts_void__pUInt)         lib.symbol("MTS_ReleaseDiagnostics");
+        GetNoteFilterMasks              = (mts_pConstVolatileUInt__void) lib.symbol("MTS_GetNoteFilterMasks");
+        GetMultiChannelNoteFilterMasks  = (mts_pConstVolatileUInt__void) lib.symbol("MTS_GetMultiChannelNoteFilterMasks");
+        GetScheduledTuningChanges       = (mts_int__double_int_pInt_pChar_pSChar_pDouble_int) lib.symbol("MTS_GetScheduledTuningChanges");
+        GetMultiChannelTuningTables     = (mts_pConstDouble__void)  lib.symbol("MTS_GetMultiChannelTuningTables");
+        SlotGetTuningTable              = (mts_pConstDouble__int)   lib.symbol("MTS_Slot_GetTuningTable");
+        SlotGetMultiChannelTuningTable  = (mts_pConstDouble__int_schar) lib.symbol("MTS_Slot_GetMultiChannelTuningTable");
+        SlotUseMultiChannelTuning       = (mts_bool__int_schar)     lib.symbol("MTS_Slot_UseMultiChannelTuning");
+        SlotGetScaleName                = (mts_pConstChar__int)     lib.symbol("MTS_Slot_GetScaleName");
+        SlotGetPeriodRatio              = (mts_double__int)         lib.symbol("MTS_Slot_GetPeriodRatio");
+        SlotGetMapSize                  = (mts_schar__int)          lib.symbol("MTS_Slot_GetMapSize");
+        SlotGetMapStartKey              = (mts_schar__int)          lib.symbol("MTS_Slot_GetMapStartKey");
+        SlotGetRefKey                   = (mts_schar__int)          lib.symbol("MTS_Slot_GetRefKey");
+        SlotGetTuningGeneration         = (mts_uint__int)           lib.symbol("MTS_Slot_GetTuningGeneration");
+        SlotGetTuningSequence           = (mts_pConstVolatileUInt__int) lib.symbol("MTS_Slot_GetTuningSequence");
+        SlotGetHasMasterFlag            = (mts_pConstVolatileUInt__int) lib.symbol("MTS_Slot_GetHasMasterFlag");
+        SlotWaitForTuningChange         = (mts_uint__int_uint_int)  lib.symbol("MTS_Slot_WaitForTuningChange");
+        SlotGetTuningChanges            = (mts_int__int_uint_pUInt_pChar_pSChar_pDouble_int) lib.symbol("MTS_Slot_GetTuningChanges");
+        SlotGetScheduledTuningChanges   = (mts_int__int_double_int_pInt_pChar_pSChar_pDouble_int) lib.symbol("MTS_Slot_GetScheduledTuningChanges");
+        SlotGetNoteFilterMasks          = (mts_pConstVolatileUInt__int) lib.symbol("MTS_Slot_GetNoteFilterMasks");
+        SlotGetMultiChannelNoteFilterMasks = (mts_pConstVolatileUInt__int) lib.symbol("MTS_Slot_GetMultiChannelNoteFilterMasks");
+        SlotGetMultiChannelTuningTables = (mts_pConstDouble__int)   lib.symbol("MTS_Slot_GetMultiChannelTuningTables");
         
-        if (shell32Module) 
-            SHGetKnownFolderPath = (SHGetKnownFolderPathFunc)GetProcAddress(shell32Module, "SHGetKnownFolderPath");
+        if (GetDiagnosticsFlag && AcquireDiagnostics && ReleaseDiagnostics)
+            diagnostics_flag = GetDiagnosticsFlag();
         
-        if (ole32Module) 
-            CoTaskMemFree = (CoTaskMemFreeFunc)GetProcAddress(ole32Module, "CoTaskMemFree");
+        defaultSlot.bind();
+        return true;
+    }
+    
+    // Slots other than 0 need every slot function, as the slot's tables can't be reached through the original ones.
+    bool supportsSlots() const
+    {
+        return SlotGetTuningTable && SlotGetMultiChannelTuningTable && SlotUseMultiChannelTuning && SlotGetScaleName &&
+               SlotGetPeriodRatio && SlotGetMapSize && SlotGetMapStartKey && SlotGetRefKey && SlotGetTuningGeneration &&
+               SlotGetTuningSequence && SlotGetHasMasterFlag && SlotWaitForTuningChange && SlotGetTuningChanges &&
+               SlotGetScheduledTuningChanges && SlotGetNoteFilterMasks && SlotGetMultiChannelNoteFilterMasks;
+    }
+};
+
+static mtsclientglobal global;
+
+bool mtsclientslot::bind()
+{
+    if (index == 0)
+    {
+        if (global.GetTuning)
+            esp_retuning = global.GetTuning();
+        
+        if (global.GetTuningSequence)
+            tuning_sequence = global.GetTuningSequence();
         
-        if (SHGetKnownFolderPath && CoTaskMemFree)
+        if (global.GetHasMasterFlag)
+            has_master_flag = global.GetHasMasterFlag();
+        
+        if (global.GetNoteFilterMasks && global.GetMultiChannelNoteFilterMasks)
         {
-            const GUID FOLDERID_ProgramFilesCommonGUID = {0xF7F1ED05, 0x9F6D, 0x47A2, 0xAA, 0xAE, 0x29, 0xD3, 0x17, 0xC6, 0xF0, 0x66};
-            PWSTR cf = NULL;
-            if (SHGetKnownFolderPath(&FOLDERID_ProgramFilesCommonGUID, 0, 0, &cf) >= 0)
-            {
-                WCHAR buffer[MAX_PATH];
-                buffer[0] = L'\0';
-                if (cf)
-                    wcsncpy(buffer, cf, MAX_PATH);
-                CoTaskMemFree(cf);
-                buffer[MAX_PATH - 1] = L'\0';
-                const WCHAR *libpath = L"\\MTS-ESP\\LIBMTS.dll";
-                DWORD cfLen = wcslen(buffer);
-                wcsncat(buffer, libpath, MAX_PATH - cfLen - 1);
-                handle = LoadLibraryW(buffer);
-                if (!handle)
-                    return;
-            }
-            else 
-            {
-                CoTaskMemFree(cf);
-                return;
-            }
+            note_filter_masks = global.GetNoteFilterMasks();
+            multi_channel_note_filter_masks = global.GetMultiChannelNoteFilterMasks();
         }
-        else
+        
+        if (global.GetMultiChannelTuningTables)
+            multi_channel_tunings = global.GetMultiChannelTuningTables();
+        
+        for (int i = 0; i < 16; i++)
         {
-            return;
+            if (multi_channel_tunings)
+                multi_channel_esp_retuning[i] = multi_channel_tunings + 128 * i;
+            else
+                multi_channel_esp_retuning[i] = global.GetMultiChannelTuning ? global.GetMultiChannelTuning(static_cast<signed char>(i)) : 0;
         }
         
-        RegisterClient                  = (mts_void__void)          GetProcAddress(handle, "MTS_RegisterClient");
-        DeregisterClient                = (mts_void__void)          GetProcAddress(handle, "MTS_DeregisterClient");
-        HasMaster                       = (mts_bool__void)          GetProcAddress(handle, "MTS_HasMaster");
-        GetVersionNumber                = (mts_int__void)           GetProcAddress(handle, "MTS_GetVersionNumber");
-        ShouldFilterNote                = (mts_bool__char_schar)    GetProcAddress(handle, "MTS_ShouldFilterNote");
-        ShouldFilterNoteMultiChannel    = (mts_bool__char_schar)    GetProcAddress(handle, "MTS_ShouldFilterNoteMultiChannel");
-        GetTuning                       = (mts_pConstDouble__void)  GetProcAddress(handle, "MTS_GetTuningTable");
-        GetMultiChannelTuning           = (mts_pConstDouble__schar) GetProcAddress(handle, "MTS_GetMultiChannelTuningTable");
-        UseMultiChannelTuning           = (mts_bool__schar)         GetProcAddress(handle, "MTS_UseMultiChannelTuning");
-        GetScaleName                    = (mts_pConstChar__void)    GetProcAddress(handle, "MTS_GetScaleName");
-        GetPeriodRatio                  = (mts_double__void)        GetProcAddress(handle, "MTS_GetPeriodRatio");
-        GetMapSize                      = (mts_schar__void)         GetProcAddress(handle, "MTS_GetMapSize");
-        GetMapStartKey                  = (mts_schar__void)         GetProcAddress(handle, "MTS_GetMapStartKey");
-        GetRefKey                       = (mts_schar__void)         GetProcAddress(handle, "MTS_GetRefKey");
+        return true;
     }
     
-    ~mtsclientglobal() 
+    if (!global.supportsSlots())
+        return false;
+    
+    esp_retuning = global.SlotGetTuningTable(index);
+    tuning_sequence = global.SlotGetTuningSequence(index);
+    has_master_flag = global.SlotGetHasMasterFlag(index);
+    note_filter_masks = global.SlotGetNoteFilterMasks(index);
+    multi_channel_note_filter_masks = global.SlotGetMultiChannelNoteFilterMasks(index);
+    multi_channel_tunings = global.SlotGetMultiChannelTuningTables ? global.SlotGetMultiChannelTuningTables(index) : 0;
+    for (int i = 0; i < 16; i++)
+        multi_channel_esp_retuning[i] = multi_channel_tunings ? multi_channel_tunings + 128 * i : global.SlotGetMultiChannelTuningTable(index, static_cast<signed char>(i));
+    
+    return esp_retuning && tuning_sequence && has_master_flag && note_filter_masks && multi_channel_note_filter_masks;
+}
+
+inline bool mtsclientslot::isOnline() const
+{
+    return esp_retuning && (has_master_flag ? *has_master_flag != 0 : (global.HasMaster && global.HasMaster()));
+}
+
+inline bool mtsclientslot::filterNote(int note, signed char midichannel) const
+{
+    if (note_filter_masks)
+        return testNoteMask(note_filter_masks + 4 * (!(midichannel & ~15) ? midichannel : 16), note);
+    return global.ShouldFilterNote && global.ShouldFilterNote(static_cast<char>(note), midichannel);
+}
+
+inline bool mtsclientslot::filterNoteMultiChannel(int note, signed char midichannel) const
+{
+    if (multi_channel_note_filter_masks)
+        return !(midichannel & ~15) && testNoteMask(multi_channel_note_filter_masks + 4 * midichannel, note);
+    return global.ShouldFilterNoteMultiChannel && global.ShouldFilterNoteMultiChannel(static_cast<char>(note), midichannel);
+}
+
+inline bool mtsclientslot::useMultiChannelTuning(signed char midichannel) const
+{
+    if (index)
+        return global.SlotUseMultiChannelTuning(index, midichannel);
+    return global.UseMultiChannelTuning && global.UseMultiChannelTuning(midichannel);
+}
+
+inline unsigned int mtsclientslot::getTuningGeneration() const
+{
+    return index ? global.SlotGetTuningGeneration(index) : global.GetTuningGeneration();
+}
+
+inline unsigned int mtsclientslot::waitForTuningChange(unsigned int lastGeneration, int timeoutMs) const
+{
+    return index ? global.SlotWaitForTuningChange(index, lastGeneration, timeoutMs) : global.WaitForTuningChange(lastGeneration, timeoutMs);
+}
+
+inline int mtsclientslot::getTuningChanges(unsigned int sinceGeneration, unsigned int *currentGeneration, char *midinotes, signed char *midichannels, double *freqs, int maxChanges) const
+{
+    if (index)
+        return global.SlotGetTuningChanges(index, sinceGeneration, currentGeneration, midinotes, midichannels, freqs, maxChanges);
+    return global.GetTuningChanges(sinceGeneration, currentGeneration, midinotes, midichannels, freqs, maxChanges);
+}
+
+inline int mtsclientslot::getScheduledTuningChanges(double blockStart, int blockLength, int *offsets, char *midinotes, signed char *midichannels, double *freqs, int maxChanges) const
+{
+    if (index)
+        return global.SlotGetScheduledTuningChanges(index, blockStart, blockLength, offsets, midinotes, midichannels, freqs, maxChanges);
+    return global.GetScheduledTuningChanges(blockStart, blockLength, offsets, midinotes, midichannels, freqs, maxChanges);
+}
+
+inline const char *mtsclientslot::getScaleName() const      {return index ? global.SlotGetScaleName(index) : global.GetScaleName();}
+inline double mtsclientslot::getPeriodRatio() const         {return index ? global.SlotGetPeriodRatio(index) : global.GetPeriodRatio();}
+inline signed char mtsclientslot::getMapSize() const        {return index ? global.SlotGetMapSize(index) : global.GetMapSize();}
+inline signed char mtsclientslot::getMapStartKey() const    {return index ? global.SlotGetMapStartKey(index) : global.GetMapStartKey();}
+inline signed char mtsclientslot::getRefKey() const         {return index ? global.SlotGetRefKey(index) : global.GetRefKey();}
+
+// Returns the slot bound, or 0 if the slot does not exist or libMTS does not support slots. Clients binding to the same
+// slot at once from several threads may each bind it, in which case all but one copy is discarded.
+mtsclientslot *mtsclientglobal::slot(int index)
+{
+    if (index < 0 || index >= eNumSlots)
+        return 0;
+    
+    mtsclientslot *bound = slots[index].load(std::memory_order_acquire);
+    if (bound)
+        return bound;
+    
+    mtsclientslot *s = new mtsclientslot(index);
+    if (!s->bind())
     {
-        if (handle)
-            FreeLibrary(handle);
+        delete s;
+        return 0;
     }
     
-    HINSTANCE handle;
-#else
-    void load_lib()
+    if (!slots[index].compare_exchange_strong(bound, s, std::memory_order_acq_rel))
     {
-        if (!(handle = dlopen("/Library/Application Support/MTS-ESP/libMTS.dylib", RTLD_NOW)) &&
-            !(handle = dlopen("/usr/local/lib/libMTS.so", RTLD_NOW)))
-        {
-            return;
-        }
-        
-        RegisterClient                  = (mts_void__void)          dlsym(handle, "MTS_RegisterClient");
-        DeregisterClient                = (mts_void__void)          dlsym(handle, "MTS_DeregisterClient");
-        HasMaster                       = (mts_bool__void)          dlsym(handle, "MTS_HasMaster");
-        GetVersionNumber                = (mts_int__void)           dlsym(handle, "MTS_GetVersionNumber");
-        ShouldFilterNote                = (mts_bool__char_schar)    dlsym(handle, "MTS_ShouldFilterNote");
-        ShouldFilterNoteMultiChannel    = (mts_bool__char_schar)    dlsym(handle, "MTS_ShouldFilterNoteMultiChannel");
-        GetTuning                       = (mts_pConstDouble__void)  dlsym(handle, "MTS_GetTuningTable");
-        GetMultiChannelTuning           = (mts_pConstDouble__schar) dlsym(handle, "MTS_GetMultiChannelTuningTable");
-        UseMultiChannelTuning           = (mts_bool__schar)         dlsym(handle, "MTS_UseMultiChannelTuning");
-        GetScaleName                    = (mts_pConstChar__void)    dlsym(handle, "MTS_GetScaleName");
-        GetPeriodRatio                  = (mts_double__void)        dlsym(handle, "MTS_GetPeriodRatio");
-        GetMapSize                      = (mts_schar__void)         dlsym(handle, "MTS_GetMapSize");
-        GetMapStartKey                  = (mts_schar__void)         dlsym(handle, "MTS_GetMapStartKey");
-        GetRefKey                       = (mts_schar__void)         dlsym(handle, "MTS_GetRefKey");
+        delete s;
+        return bound;
     }
-    
-    ~mtsclientglobal()
+    return s;
+}
+
+static int toCentsQ16(double semitones)
+{
+    double cents = semitones * semitonesToCentsQ16;
+    if (!(cents > -2147483647.0)) // also catches NaN, and -inf from a frequency of zero
+        return -2147483647;
+    if (cents > 2147483647.0)
+        return 2147483647;
+    return static_cast<int>(lround(cents));
+}
+
+void mtstuningtable::set(const double *freqs)
+{
+    for (int i = 0; i < 128; i++)
+        ratio[i] = freqs[i] * global.iet[i];
+    for (int i = 0; i < 128; i++)
+        semitones[i] = ratioToSemitones * log(ratio[i]);
+    for (int i = 0; i < 128; i++)
     {
-        if (handle)
-            dlclose(handle);
+        freqFloat[i] = static_cast<float>(freqs[i]);
+        ratioFloat[i] = static_cast<float>(ratio[i]);
+        semitonesFloat[i] = static_cast<float>(semitones[i]);
+        centsQ16[i] = toCentsQ16(semitones[i]);
     }
+    for (int i = 0; i < 128; i++)
+        freq[i] = freqs[i];
+}
+
+double mtstuningtable::entry(const double (mtstuningtable::*table)[128], int note, double f)
+{
+    if (table == &mtstuningtable::freq)
+        return f;
+    double r = f * global.iet[note];
+    return table == &mtstuningtable::ratio ? r : ratioToSemitones * log(r);
+}
+
+float mtstuningtable::entry(const float (mtstuningtable::*table)[128], int note, double f)
+{
+    if (table == &mtstuningtable::freqFloat)
+        return static_cast<float>(f);
+    return static_cast<float>(entry(table == &mtstuningtable::ratioFloat ? &mtstuningtable::ratio : &mtstuningtable::semitones, note, f));
+}
+
+int mtstuningtable::entry(const int (mtstuningtable::*)[128], int note, double f)
+{
+    return toCentsQ16(entry(&mtstuningtable::semitones, note, f));
+}
+
+// Takes a consistent copy of a table being written by the master before deriving anything from it, then rebuilds the
+// table unless another thread is already doing so. Returns false if the table was not rebuilt, in which case the previous
+// snapshot is kept and the update is retried on the next query. Never waits on the master or on other clients.
+bool mtstuningtable::update(const double *sharedFreqs, const mtsclientslot &slot)
+{
+    double f[128];
+    if (!slot.readTable(f, sharedFreqs))
+        return false;
     
-    void *handle;
-#endif
-};
+    unsigned int s = sequence.load(std::memory_order_relaxed);
+    if ((s & 1) || !sequence.compare_exchange_strong(s, s + 1, std::memory_order_acquire, std::memory_order_relaxed))
+        return false;
+    std::atomic_thread_fence(std::memory_order_release);
+    set(f);
+    sequence.store(s + 2, std::memory_order_release);
+    return true;
+}
 
-static mtsclientglobal global;
+void mtstuningtable::reset()
+{
+    for (int i = 0; i < 128; i++)
+    {
+        freq[i] = 1.0 / global.iet[i];
+        ratio[i] = 1.0;
+        semitones[i] = 0.0;
+        freqFloat[i] = static_cast<float>(freq[i]);
+        ratioFloat[i] = 1.f;
+        semitonesFloat[i] = 0.f;
+        centsQ16[i] = 0;
+    }
+}
 
 struct MTSClient
 {
-    struct Tuning
-    {
-        enum {eRatioValid = 1, eSemitonesValid = 1 << 1};
-        int flags;
-        double freq; // always valid
-        double ratio;
-        double semitones;
-    };
-    
     MTSClient()
-    : tuningName("12-TET")
+    : slot(&global.defaultSlot)
+    , tuningName("12-TET")
     , periodRatioLocal(2.0)
     , periodSemitones(12.0)
     , mapSizeLocal(static_cast<signed char>(-1))
@@ -217,234 +987,531 @@ struct MTSClient
     , supportsMultiChannelTuning(false)
     , freqRequestReceived(false)
     , receivedMTSSysEx(false)
+    , localTuningChanged(false)
+    , wasOnline(false)
+    , libGeneration(0)
+    , generation(0)
+    , onlineGeneration(0)
+    , waitGeneration(global.GetTuningGeneration ? global.GetTuningGeneration() : 0)
+    , localTuningCount(0)
+    , changesLocalTuningCount(0)
+    , changesGeneration(0)
+    , changesOnline(false)
+    , changesValid(false)
+    , sysexState(eIgnoring)
+    , sysexFormat(eBulk)
+    , sysexCtr(0)
+    , sysexValue(0)
+    , sysexNote(0)
+    , sysexNumTunings(0)
+    , diagnostics(0)
+    , diagnosticsUnavailableFlag(0)
+    , pitchBendRange(48.0)
+    , pitchBendFirstChannel(1)
+    , pitchBendNumChannels(15)
+    , pitchBendNextChannel(0)
+    , keyFreqs(0)
     {
-        for (int i = 0; i < 128; i++)
-        {
-            localFreqs[i] = 440.0 * pow(2.0, (i - 69.0) / 12.0);
-            localTunings[i].flags = 0;
-            localTunings[i].freq = localFreqs[i];
-            globalTunings[i].flags = 0;
-            globalTunings[i].freq = localFreqs[i];
-        }
+        for (int i = 0; i < eNumNoteIndices; i++)
+            noteIndices[i] = 0;
+        
+        for (int i = 0; i < 17; i++)
+            pitchBendTables[i] = 0;
         
         for (int i = 0; i < 16; i++)
-        {
-            for (int j = 0; j < 128; j++)
-            {
-                globalMultichannelTunings[i][j].flags = 0;
-                globalMultichannelTunings[i][j].freq = localFreqs[i];
-            }
-        }
-                
+            pitchBendChannelNotes[i] = 0;
+        
+        for (int i = 0; i < 128; i++)
+            localFreqs[i] = pendingFreqs[i] = 440.0 * pow(2.0, (i - 69.0) / 12.0);
+        
+        pendingName[0] = '\0';
+        
+        localTunings.reset();
+        
         if (global.RegisterClient)
             global.RegisterClient();
+        
+        claimDiagnostics(true);
     }
     
     ~MTSClient()
     {
         if (global.DeregisterClient)
             global.DeregisterClient();
+        
+        if (diagnostics)
+            global.ReleaseDiagnostics(diagnostics);
+        
+        for (int i = 0; i < eNumNoteIndices; i++)
+            delete noteIndices[i];
+        
+        for (int i = 0; i < 17; i++)
+            delete pitchBendTables[i];
+        
+        delete keyFreqs;
     }
     
-    inline bool hasMaster() {return global.isOnline();}
-    inline bool shouldUpdateLibrary() {return global.GetVersionNumber ? (global.GetVersionNumber() < libMTSVersion) : false;}
+    // Counters published to the master whilst it has enabled diagnostics, in the order of MTSDiagnosticCounter in libMTSMaster.h.
+    enum eDiagnosticCounter
+    {
+        eDiagFrequencyQueries = 0,
+        eDiagRatioQueries,
+        eDiagSemitoneQueries,
+        eDiagFloatAndFixedPointQueries,
+        eDiagBatchQueries,
+        eDiagBatchNotes,
+        eDiagSnapshots,
+        eDiagFilterQueries,
+        eDiagFrequencyToNoteQueries,
+        eDiagMultiChannelTableHits,
+        eDiagMainTableHits,
+        eDiagLocalTableHits,
+        eDiagTableRefreshes,
+        eDiagNoteIndexRebuilds,
+        eDiagSysExBytes,
+        eNumDiagnosticCounters
+    };
     
-    inline double freq(char midinote, signed char midichannel)
+    // Claims an entry for the counters in libMTS. Claiming takes file locks, so is only done when the client registers and
+    // from calls that are never made on the audio thread. If every entry is taken, the client tries again from those calls
+    // once the flag changes, as libMTS changes it when diagnostics are enabled again or an entry is released.
+    void claimDiagnostics(bool registering = false)
     {
-        int note = midinote & 127;
-        int channel = midichannel & 15;
+        if (diagnostics || !global.diagnostics_flag)
+            return;
+        
+        unsigned int flag = *global.diagnostics_flag;
+        if ((registering || flag != diagnosticsUnavailableFlag) && !(diagnostics = global.AcquireDiagnostics()))
+            diagnosticsUnavailableFlag = flag;
+    }
+    
+    // Costs one read of a flag published by libMTS whilst diagnostics are disabled, or if the client has no entry.
+    // Counts are approximate if a client is queried from several threads at once.
+    inline void count(eDiagnosticCounter counter, unsigned int n = 1)
+    {
+        if (diagnostics && *global.diagnostics_flag)
+            diagnostics[counter] += n;
+    }
+    
+    // Returns an entry of a shared table, refreshing the table first if it no longer matches its source at the queried note.
+    // The source is read without the sequence lock only to compare it with the table, which always holds a consistent copy.
+    // If the table can't be refreshed, as another thread is refreshing it or the master is writing to the source, the entry
+    // is computed from a frequency read under the sequence lock, or else the last consistent entry of the table is returned.
+    template <typename T>
+    inline T sharedEntry(mtstuningtable &table, const T (mtstuningtable::*entries)[128], const double *sharedFreqs, int note)
+    {
+        T value;
+        if (table.read(entries, note, sharedFreqs[note], value))
+            return value;
+        
+        count(eDiagTableRefreshes);
+        if (table.update(sharedFreqs, *slot) && table.read(entries, note, value))
+            return value;
         
+        for (int attempt = 0; attempt < mtsclientslot::eMaxSnapshotAttempts; attempt++)
+        {
+            double f;
+            if (slot->readTable(&f, sharedFreqs + note, 1))
+                return mtstuningtable::entry(entries, note, f);
+            if (table.read(entries, note, value))
+                return value;
+        }
+        
+        // Only if both the master and the thread refreshing the table have stopped mid-write, e.g. a crashed master and
+        // a suspended host thread. A single entry is written with one store, so holds a value from one snapshot or the other.
+        return (table.*entries)[note];
+    }
+    
+    inline bool hasMaster() {return slot->isOnline();}
+    inline bool shouldUpdateLibrary()
+    {
+        claimDiagnostics();
+        return global.GetVersionNumber ? (global.GetVersionNumber() < libMTSVersion) : false;
+    }
+    
+    // Returns an entry of the table to use for a note, refreshed if the master has changed it since it was last queried.
+    template <typename T>
+    inline T tuningEntry(const T (mtstuningtable::*entries)[128], int note, signed char midichannel)
+    {
         freqRequestReceived = true;
         supportsMultiChannelTuning = !(midichannel & ~15);
         
-        if (!global.isOnline())
-            return localTunings[note].freq;
+        if (!slot->isOnline())
+        {
+            count(eDiagLocalTableHits);
+            return (localTunings.*entries)[note];
+        }
+        
+        int channel = midichannel & 15;
         
         if ((!supportsNoteFiltering || supportsMultiChannelNoteFiltering) &&
             supportsMultiChannelTuning &&
-            global.UseMultiChannelTuning &&
-            global.UseMultiChannelTuning(midichannel) &&
-            global.multi_channel_esp_retuning[channel])
+            slot->useMultiChannelTuning(midichannel) &&
+            slot->multi_channel_esp_retuning[channel])
         {
-            globalMultichannelTunings[channel][note].freq = global.multi_channel_esp_retuning[channel][note];
-            globalMultichannelTunings[channel][note].flags = 0;
-            return globalMultichannelTunings[channel][note].freq;
+            count(eDiagMultiChannelTableHits);
+            return sharedEntry(slot->globalMultichannelTunings[channel], entries, slot->multi_channel_esp_retuning[channel], note);
         }
         
-        globalTunings[note].freq = global.esp_retuning[note];
-        globalTunings[note].flags = 0;
-        return globalTunings[note].freq;
+        count(eDiagMainTableHits);
+        return sharedEntry(slot->globalTunings, entries, slot->esp_retuning, note);
+    }
+    
+    inline double freq(char midinote, signed char midichannel)
+    {
+        int note = midinote & 127;
+        count(eDiagFrequencyQueries);
+        return tuningEntry(&mtstuningtable::freq, note, midichannel);
     }
     
     inline double ratio(char midinote, signed char midichannel)
     {
         int note = midinote & 127;
-        int channel = midichannel & 15;
+        count(eDiagRatioQueries);
+        return tuningEntry(&mtstuningtable::ratio, note, midichannel);
+    }
+    
+    inline double semitones(char midinote, signed char midichannel)
+    {
+        int note = midinote & 127;
+        count(eDiagSemitoneQueries);
+        return tuningEntry(&mtstuningtable::semitones, note, midichannel);
+    }
+    
+    // Returns an entry of one of the precomputed tables, in the table's own format.
+    template <typename T>
+    inline T query(const T (mtstuningtable::*table)[128], char midinote, signed char midichannel)
+    {
+        int note = midinote & 127;
+        count(eDiagFloatAndFixedPointQueries);
+        return tuningEntry(table, note, midichannel);
+    }
+    
+    // Blocks until libMTS reports that the master has changed something since the previous call, or until the timeout
+    // expires. Only touches state used by the waiting thread, so may be called from a different thread to queries.
+    // An older libMTS can't report changes, in which case this sleeps for the timeout and assumes there was a change.
+    inline bool waitForTuningChange(int timeoutMs)
+    {
+        claimDiagnostics();
+        
+        if (!global.WaitForTuningChange || !global.GetTuningGeneration)
+        {
+            if (timeoutMs > 0)
+            {
+#ifdef MTS_ESP_WIN
+                Sleep(static_cast<DWORD>(timeoutMs));
+#else
+                usleep(static_cast<useconds_t>(timeoutMs) * 1000);
+#endif
+            }
+            return true;
+        }
         
+        unsigned int g = slot->waitForTuningChange(waitGeneration, timeoutMs);
+        bool changed = g != waitGeneration;
+        waitGeneration = g;
+        return changed;
+    }
+    
+    // Copies the frequencies of all 128 notes as seen by this client, for a given MIDI channel argument. The copy is
+    // consistent, i.e. never a mix of tables from before and after a master update, if supported by libMTS.
+    inline void tuningSnapshot(double *freqs, signed char midichannel)
+    {
+        if (!freqs)
+            return;
+        
+        count(eDiagSnapshots);
         freqRequestReceived = true;
         supportsMultiChannelTuning = !(midichannel & ~15);
         
-        if (!global.isOnline())
+        if (!slot->isOnline())
         {
-            if (!receivedMTSSysEx)
-                return 1.0;
-            
-            if (localTunings[note].flags & Tuning::eRatioValid)
-                return localTunings[note].ratio;
-            
-            localTunings[note].ratio = localTunings[note].freq * global.iet[note];
-            localTunings[note].flags |= Tuning::eRatioValid;
-            return localTunings[note].ratio;
+            for (int i = 0; i < 128; i++)
+                freqs[i] = localTunings.freq[i];
+            return;
         }
         
+        int channel = midichannel & 15;
+        const double *src = slot->esp_retuning;
+        mtstuningtable *t = &slot->globalTunings;
+        
         if ((!supportsNoteFiltering || supportsMultiChannelNoteFiltering) &&
             supportsMultiChannelTuning &&
-            global.UseMultiChannelTuning &&
-            global.UseMultiChannelTuning(midichannel) &&
-            global.multi_channel_esp_retuning[channel])
+            slot->useMultiChannelTuning(midichannel) &&
+            slot->multi_channel_esp_retuning[channel])
+        {
+            src = slot->multi_channel_esp_retuning[channel];
+            t = &slot->globalMultichannelTunings[channel];
+        }
+        
+        if (!slot->readTable(freqs, src) && !t->readFreqs(freqs))
+        {
+            for (int i = 0; i < 128; i++)
+                freqs[i] = src[i];
+        }
+    }
+    
+    // Batch queries resolve online state and multi-channel eligibility once per call, then only call
+    // UseMultiChannelTuning() once for each distinct MIDI channel present in the batch. Results are copied from one of
+    // the precomputed tables, in the table's own format.
+    template <typename T>
+    inline void batchQuery(const T (mtstuningtable::*table)[128], const char *midinotes, const signed char *midichannels, T *results, int numNotes)
+    {
+        if (!midinotes || !results || numNotes <= 0)
+            return;
+        
+        count(eDiagBatchQueries);
+        count(eDiagBatchNotes, static_cast<unsigned int>(numNotes));
+        freqRequestReceived = true;
+        supportsMultiChannelTuning = midichannels != 0;
+        for (int i = 0; i < numNotes && supportsMultiChannelTuning; i++)
+            supportsMultiChannelTuning = !(midichannels[i] & ~15);
+        
+        bool online = slot->isOnline();
+        bool multiChannelAllowed = online && (!supportsNoteFiltering || supportsMultiChannelNoteFiltering);
+        signed char channelState[16]; // -1 = not yet queried, 0 = use global table, 1 = use multi-channel table
+        for (int i = 0; i < 16; i++)
+            channelState[i] = -1;
+        
+        for (int i = 0; i < numNotes; i++)
         {
-            double freq = global.multi_channel_esp_retuning[channel][note];
+            int note = midinotes[i] & 127;
+            signed char midichannel = midichannels ? midichannels[i] : static_cast<signed char>(-1);
+            int channel = midichannel & 15;
             
-            if (globalMultichannelTunings[channel][note].freq == freq &&
-                (globalMultichannelTunings[channel][note].flags & Tuning::eRatioValid))
+            if (multiChannelAllowed && !(midichannel & ~15))
             {
-                return globalMultichannelTunings[channel][note].ratio;
+                if (channelState[channel] < 0)
+                    channelState[channel] = (slot->useMultiChannelTuning(midichannel) && slot->multi_channel_esp_retuning[channel]) ? 1 : 0;
+                if (channelState[channel] > 0)
+                {
+                    count(eDiagMultiChannelTableHits);
+                    results[i] = sharedEntry(slot->globalMultichannelTunings[channel], table, slot->multi_channel_esp_retuning[channel], note);
+                    continue;
+                }
             }
             
-            globalMultichannelTunings[channel][note].freq = global.multi_channel_esp_retuning[channel][note];
-            globalMultichannelTunings[channel][note].ratio = globalMultichannelTunings[channel][note].freq * global.iet[note];
-            globalMultichannelTunings[channel][note].flags = Tuning::eRatioValid;
-            return globalMultichannelTunings[channel][note].ratio;
+            if (online)
+            {
+                count(eDiagMainTableHits);
+                results[i] = sharedEntry(slot->globalTunings, table, slot->esp_retuning, note);
+            }
+            else
+            {
+                count(eDiagLocalTableHits);
+                results[i] = (localTunings.*table)[note];
+            }
         }
+    }
+    
+    // Records what the plugin supports from a note filtering query, and returns whether the multi-channel filter applies.
+    inline bool noteFilterQuery(signed char midichannel)
+    {
+        count(eDiagFilterQueries);
+        supportsNoteFiltering = true;
+        supportsMultiChannelNoteFiltering = !(midichannel & ~15);
         
-        double freq = global.esp_retuning[note];
+        if (!freqRequestReceived)
+            supportsMultiChannelTuning = supportsMultiChannelNoteFiltering; // assume it supports multi channel tuning until a request is received for a frequency and can verify
         
-        if (globalTunings[note].freq == freq &&
-            (globalTunings[note].flags & Tuning::eRatioValid))
-        {
-            return globalTunings[note].ratio;
-        }
+        return slot->isOnline() &&
+               supportsMultiChannelNoteFiltering &&
+               supportsMultiChannelTuning &&
+               slot->useMultiChannelTuning(midichannel);
+    }
+    
+    inline bool shouldFilterNote(char midinote, signed char midichannel)
+    {
+        if (noteFilterQuery(midichannel))
+            return slot->filterNoteMultiChannel(midinote & 127, midichannel);
         
-        globalTunings[note].freq = global.esp_retuning[note];
-        globalTunings[note].ratio = globalTunings[note].freq * global.iet[note];
-        globalTunings[note].flags = Tuning::eRatioValid;
-        return globalTunings[note].ratio;
+        return slot->isOnline() && slot->filterNote(midinote & 127, midichannel);
     }
     
-    inline double semitones(char midinote, signed char midichannel)
+    // Fills mask with the result of shouldFilterNote() for every note, bit (note & 31) of mask[note >> 5], copying the
+    // masks published by libMTS where possible.
+    inline void noteFilterMask(signed char midichannel, unsigned int *mask)
     {
-        int note = midinote & 127;
+        bool multiChannel = noteFilterQuery(midichannel);
+        bool online = slot->isOnline();
+        
+        const volatile unsigned int *masks = multiChannel ? slot->multi_channel_note_filter_masks : slot->note_filter_masks;
+        if (online && masks && slot->readTable(mask, masks + 4 * (!(midichannel & ~15) ? midichannel : 16), 4))
+            return;
+        
+        for (int i = 0; i < 4; i++)
+            mask[i] = 0;
+        
+        if (!online)
+            return;
+        
+        for (int note = 0; note < 128; note++)
+            if (multiChannel ? slot->filterNoteMultiChannel(note, midichannel) : slot->filterNote(note, midichannel))
+                mask[note >> 5] |= 1u << (note & 31);
+    }
+    
+    // Note indices are built on first use and rebuilt whenever the tuning generation changes. One index exists for each
+    // MIDI channel argument, as note filtering can be channel-specific, and one for MTS_FrequencyToNoteAndChannel().
+    enum {eGeneralNoteIndex = 0, eMultiChannelNoteIndex = 17, eAllChannelsNoteIndex = 33, eNumNoteIndices};
+    
+    inline mtsnoteindex &noteIndex(int i, int capacity)
+    {
+        if (!noteIndices[i])
+            noteIndices[i] = new mtsnoteindex(capacity);
+        return *noteIndices[i];
+    }
+    
+    // Returns the index searched for a given MIDI channel argument, rebuilt if the generation has changed.
+    inline mtsnoteindex &channelNoteIndex(signed char midichannel, bool online, unsigned int gen)
+    {
+        bool multiChannel = online &&
+                            !(midichannel & ~15) &&
+                            slot->useMultiChannelTuning(midichannel) &&
+                            slot->multi_channel_esp_retuning[midichannel & 15];
+        
         int channel = midichannel & 15;
+        mtsnoteindex &index = noteIndex(multiChannel ? eMultiChannelNoteIndex + channel : eGeneralNoteIndex + (!(midichannel & ~15) ? channel + 1 : 0), 128);
         
-        freqRequestReceived = true;
-        supportsMultiChannelTuning = !(midichannel & ~15);
+        if (index.valid && index.generation == gen)
+            return index;
+        
+        const double *freqs = online ? slot->esp_retuning : localFreqs;
+        if (multiChannel)
+            freqs = slot->multi_channel_esp_retuning[channel];
         
-        if (!global.isOnline())
+        index.clear();
+        for (int i = 0; i < 128; i++)
         {
-            if (!receivedMTSSysEx)
-                return 0.0;
+            if (online)
+            {
+                if (multiChannel ? slot->filterNoteMultiChannel(i, midichannel) : slot->filterNote(i, midichannel))
+                    continue;
+            }
             
-            if (localTunings[note].flags & Tuning::eSemitonesValid)
-                return localTunings[note].semitones;
+            index.add(freqs[i], 0, i);
+        }
+        index.finish(gen);
+        count(eDiagNoteIndexRebuilds);
+        return index;
+    }
+    
+    // Returns the index of all multi-channel tables in use, rebuilt if the generation has changed. Only valid when online.
+    inline mtsnoteindex &allChannelsNoteIndex(unsigned int gen)
+    {
+        mtsnoteindex &index = noteIndex(eAllChannelsNoteIndex, 16 * 128);
+        
+        if (index.valid && index.generation == gen)
+            return index;
+        
+        index.clear();
+        for (int channel = 0; channel < 16; channel++)
+        {
+            if (!slot->useMultiChannelTuning(static_cast<signed char>(channel)) || !slot->multi_channel_esp_retuning[channel])
+                continue;
             
-            if (localTunings[note].flags & Tuning::eRatioValid)
+            index.numTables++;
+            for (int note = 0; note < 128; note++)
             {
-                localTunings[note].semitones = ratioToSemitones * log(localTunings[note].ratio);
-                localTunings[note].flags |= Tuning::eSemitonesValid;
-                return localTunings[note].semitones;
+                if (slot->filterNoteMultiChannel(note, static_cast<signed char>(channel)))
+                    continue;
+                
+                index.add(slot->multi_channel_esp_retuning[channel][note], channel, note);
             }
-            
-            localTunings[note].ratio = localTunings[note].freq * global.iet[note];
-            localTunings[note].semitones = ratioToSemitones * log(localTunings[note].ratio);
-            localTunings[note].flags |= Tuning::eRatioValid | Tuning::eSemitonesValid;
-            return localTunings[note].semitones;
+        }
+        index.finish(gen);
+        count(eDiagNoteIndexRebuilds);
+        return index;
+    }
+    
+    inline char freqToNote(double freq, signed char midichannel)
+    {
+        count(eDiagFrequencyToNoteQueries);
+        bool online = slot->isOnline();
+        
+        // Without a generation counter from libMTS changes to note filtering can't be detected, so the index can't be used.
+        if (online && !global.GetTuningGeneration)
+            return freqToNoteLinear(freq, midichannel);
+        
+        return static_cast<char>(channelNoteIndex(midichannel, online, cacheGeneration()).find(freq) & 127);
+    }
+    
+    inline char freqToNote(double freq, signed char *midichannel)
+    {
+        if (!midichannel)
+            return freqToNote(freq, static_cast<signed char>(-1));
+        
+        if (!slot->isOnline() || !global.UseMultiChannelTuning)
+        {
+            *midichannel = static_cast<signed char>(0);
+            return freqToNote(freq, static_cast<signed char>(0));
         }
         
-        if ((!supportsNoteFiltering || supportsMultiChannelNoteFiltering) &&
-            supportsMultiChannelTuning &&
-            global.UseMultiChannelTuning &&
-            global.UseMultiChannelTuning(midichannel) &&
-            global.multi_channel_esp_retuning[channel])
+        if (!global.GetTuningGeneration)
         {
-            double freq = global.multi_channel_esp_retuning[channel][note];
-            
-            if (globalMultichannelTunings[channel][note].freq == freq)
-            {
-                if (globalMultichannelTunings[channel][note].flags & Tuning::eSemitonesValid)
-                    return globalMultichannelTunings[channel][note].semitones;
-                
-                if (globalMultichannelTunings[channel][note].flags & Tuning::eRatioValid)
-                {
-                    globalMultichannelTunings[channel][note].semitones = ratioToSemitones * log(globalMultichannelTunings[channel][note].ratio);
-                    globalMultichannelTunings[channel][note].flags |= Tuning::eSemitonesValid;
-                    return globalMultichannelTunings[channel][note].semitones;
-                }
-            }
-            
-            globalMultichannelTunings[channel][note].freq = freq;
-            globalMultichannelTunings[channel][note].ratio = freq * global.iet[note];
-            globalMultichannelTunings[channel][note].semitones = ratioToSemitones * log(globalMultichannelTunings[channel][note].ratio);
-            globalMultichannelTunings[channel][note].flags = Tuning::eRatioValid | Tuning::eSemitonesValid;
-            return globalMultichannelTunings[channel][note].semitones;
+            count(eDiagFrequencyToNoteQueries);
+            return freqToNoteLinear(freq, midichannel);
         }
         
-        double freq = global.esp_retuning[note];
+        mtsnoteindex &index = allChannelsNoteIndex(cacheGeneration());
         
-        if (globalTunings[note].freq == freq)
+        if (index.numTables == 0)
         {
-            if (globalTunings[note].flags & Tuning::eSemitonesValid)
-                return globalTunings[note].semitones;
-            
-            if (globalTunings[note].flags & Tuning::eRatioValid)
-            {
-                globalTunings[note].semitones = ratioToSemitones * log(globalTunings[note].ratio);
-                globalTunings[note].flags |= Tuning::eSemitonesValid;
-                return globalTunings[note].semitones;
-            }
+            *midichannel = static_cast<signed char>(0);
+            return freqToNote(freq, static_cast<signed char>(0));
         }
         
-        globalTunings[note].freq = freq;
-        globalTunings[note].ratio = freq * global.iet[note];
-        globalTunings[note].semitones = ratioToSemitones * log(globalTunings[note].ratio);
-        globalTunings[note].flags = Tuning::eRatioValid | Tuning::eSemitonesValid;
-        return globalTunings[note].semitones;
+        count(eDiagFrequencyToNoteQueries);
+        int key = index.find(freq);
+        *midichannel = static_cast<signed char>(key >> 7);
+        return static_cast<char>(key & 127);
     }
     
-    inline bool shouldFilterNote(char midinote, signed char midichannel)
+    // Finds notes and channels for several simultaneous frequencies. The index is fetched once for the whole batch, even
+    // with an older libMTS, and each frequency is given the nearest (note, channel) pair not already given to another.
+    inline void freqsToNotes(const double *freqs, char *midinotes, signed char *midichannels, int num)
     {
-        supportsNoteFiltering = true;
-        supportsMultiChannelNoteFiltering = !(midichannel & ~15);
-        
-        if (!freqRequestReceived)
-            supportsMultiChannelTuning = supportsMultiChannelNoteFiltering; // assume it supports multi channel tuning until a request is received for a frequency and can verify
+        if (!freqs || !midinotes || !midichannels || num <= 0)
+            return;
         
-        if (!global.isOnline())
-            return false;
+        count(eDiagFrequencyToNoteQueries, static_cast<unsigned int>(num));
+        bool online = slot->isOnline();
+        unsigned int gen = cacheGeneration();
+        mtsnoteindex *index = 0;
         
-        if (supportsMultiChannelNoteFiltering &&
-            supportsMultiChannelTuning &&
-            global.UseMultiChannelTuning &&
-            global.UseMultiChannelTuning(midichannel))
+        if (online && global.UseMultiChannelTuning)
         {
-            return global.ShouldFilterNoteMultiChannel ? global.ShouldFilterNoteMultiChannel(midinote & 127, midichannel) : false;
+            index = &allChannelsNoteIndex(gen);
+            if (index->numTables == 0)
+                index = 0;
         }
         
-        return global.ShouldFilterNote ? global.ShouldFilterNote(midinote & 127, midichannel) : false;
+        if (!index)
+            index = &channelNoteIndex(static_cast<signed char>(0), online, gen);
+        
+        unsigned int used[16 * 128 / 32];
+        for (int i = 0; i < 16 * 128 / 32; i++)
+            used[i] = 0;
+        
+        for (int i = 0; i < num; i++)
+        {
+            int key = index->findUnused(freqs[i], used);
+            midinotes[i] = static_cast<char>(key & 127);
+            midichannels[i] = static_cast<signed char>(key >> 7);
+        }
     }
     
-    inline char freqToNote(double freq, signed char midichannel)
+    inline char freqToNoteLinear(double freq, signed char midichannel)
     {
-        bool online = global.isOnline();
+        bool online = slot->isOnline();
         bool multiChannel = false;
-        const double *freqs = online ? global.esp_retuning : localFreqs;
+        const double *freqs = online ? slot->esp_retuning : localFreqs;
         
         if (online &&
             !(midichannel & ~15) &&
-            global.UseMultiChannelTuning &&
-            global.UseMultiChannelTuning(midichannel) &&
-            global.multi_channel_esp_retuning[midichannel & 15])
+            slot->useMultiChannelTuning(midichannel) &&
+            slot->multi_channel_esp_retuning[midichannel & 15])
         {
-            freqs = global.multi_channel_esp_retuning[midichannel & 15];
+            freqs = slot->multi_channel_esp_retuning[midichannel & 15];
             multiChannel = true;
         }
         
@@ -457,19 +1524,8 @@ struct MTSClient
         {
             if (online)
             {
-                if (multiChannel && 
-                    global.ShouldFilterNoteMultiChannel &&
-                    global.ShouldFilterNoteMultiChannel(static_cast<char>(i), midichannel))
-                {
-                    continue;
-                }
-                
-                if (!multiChannel &&
-                    global.ShouldFilterNote &&
-                    global.ShouldFilterNote(static_cast<char>(i), midichannel))
-                {
+                if (multiChannel ? slot->filterNoteMultiChannel(i, midichannel) : slot->filterNote(i, midichannel))
                     continue;
-                }
             }
             
             double d = freqs[i] - freq;
@@ -502,17 +1558,15 @@ struct MTSClient
         return freq < fmid ? static_cast<char>(iLower) : static_cast<char>(iUpper);
     }
     
-    inline char freqToNote(double freq, signed char *midichannel)
+    inline char freqToNoteLinear(double freq, signed char *midichannel)
     {
-        if (!midichannel) 
-            return freqToNote(freq, static_cast<signed char>(-1));
-        
-        if (global.isOnline() && global.UseMultiChannelTuning)
+
+        if (slot->isOnline() && global.UseMultiChannelTuning)
         {
             int channelsInUse[16];
             int nMultiChannels = 0;
             for (int i = 0; i < 16; i++)
-                if (global.UseMultiChannelTuning(i) && global.multi_channel_esp_retuning[i])
+                if (slot->useMultiChannelTuning(i) && slot->multi_channel_esp_retuning[i])
                     channelsInUse[nMultiChannels++] = i;
             
             if (nMultiChannels > 0)
@@ -530,13 +1584,10 @@ struct MTSClient
                     channel = channelsInUse[i >> 7];
                     note = i & 127;
                     
-                    if (global.ShouldFilterNoteMultiChannel &&
-                        global.ShouldFilterNoteMultiChannel(static_cast<char>(note), static_cast<signed char>(channel)))
-                    {
+                    if (slot->filterNoteMultiChannel(note, static_cast<signed char>(channel)))
                         continue;
-                    }
                     
-                    double d = global.multi_channel_esp_retuning[channel][note] - freq;
+                    double d = slot->multi_channel_esp_retuning[channel][note] - freq;
                     
                     if (d == 0.0)
                     {
@@ -571,8 +1622,8 @@ struct MTSClient
                     return static_cast<char>(iLower & 127);
                 }
                 
-                double fLower = global.multi_channel_esp_retuning[channelsInUse[iLower >> 7]][iLower & 127];
-                double fUpper = global.multi_channel_esp_retuning[channelsInUse[iUpper >> 7]][iUpper & 127];
+                double fLower = slot->multi_channel_esp_retuning[channelsInUse[iLower >> 7]][iLower & 127];
+                double fUpper = slot->multi_channel_esp_retuning[channelsInUse[iUpper >> 7]][iUpper & 127];
                 double fmid = fLower * pow(2.0, 0.5 * (log(fUpper / fLower) / ln2));
                 
                 if (freq < fmid)
@@ -587,147 +1638,254 @@ struct MTSClient
         }
         
         *midichannel = static_cast<signed char>(0);
-        return freqToNote(freq, static_cast<signed char>(0));
+        return freqToNoteLinear(freq, static_cast<signed char>(0));
+    }
+    
+    enum eSysexState {eIgnoring = 0, eMatchingSysex, eSysexValid, eMatchingMTS, eMatchingBank, eMatchingProg, eMatchingChannel, eTuningName, eNumTunings, eTuningData, eCheckSum};
+    enum eMTSFormat {eRequest = 0, eBulk, eSingle, eScaleOctOneByte, eScaleOctTwoByte, eScaleOctOneByteExt, eScaleOctTwoByteExt};
+    
+    // 2^(semitones / 12) for |semitones| <= 1, the range of every MTS detune value, from a degree 9 Taylor polynomial for
+    // exp(). Its truncation error is below 1e-19. Combined with the equal-tempered table, frequencies are within 5 ulp
+    // (1.1e-15 relative) of 440 * pow(2, (note + semitones - 69) / 12), as checked for every detune value of every format
+    // by Tests/SysExDecoderTest.cpp. This replaces a call to pow() for every note received via MTS SysEx.
+    static inline double semitoneRatio(double semitones)
+    {
+        const double x = semitones * (ln2 / 12.0);
+        return 1.0 + x * (1.0 + x * (1.0 / 2.0 + x * (1.0 / 6.0 + x * (1.0 / 24.0 + x * (1.0 / 120.0 + x * (1.0 / 720.0 + x * (1.0 / 5040.0 + x * (1.0 / 40320.0 + x * (1.0 / 362880.0)))))))));
+    }
+    
+    // Decodes a bulk dump or scale/octave message which is complete in the buffer, starting at the 0xF0 at buffer[0], in a
+    // few passes over the whole message rather than a byte at a time. Tuning words are unpacked first and converted to
+    // frequencies in a separate loop without branches or calls, which compilers can vectorize. Results are identical to
+    // those of the state machine in parseMIDIData(), as both use the same frequency calculation. Returns the number of
+    // bytes consumed, or 0 if the message is another format, is fragmented or contains status bytes, in which case it is
+    // left to the state machine.
+    inline int decodeMessage(const unsigned char *buffer, int len)
+    {
+        if (len < 5 || (buffer[1] != 0x7E && buffer[1] != 0x7F) || buffer[2] > 0x7F || buffer[3] != 0x08)
+            return 0;
+        
+        eMTSFormat messageFormat;
+        int start = 5;
+        bool named = true;
+        bool checksum = true;
+        int dataSize = 0;
+        switch (buffer[4])
+        {
+            case 1: messageFormat = eBulk; start += 1; dataSize = 384; break;
+            case 4: messageFormat = eBulk; start += 2; dataSize = 384; break;
+            case 5: messageFormat = eScaleOctOneByte; start += 2; dataSize = 12; break;
+            case 6: messageFormat = eScaleOctTwoByte; start += 2; dataSize = 24; break;
+            case 8: messageFormat = eScaleOctOneByteExt; start += 3; named = false; checksum = false; dataSize = 12; break;
+            case 9: messageFormat = eScaleOctTwoByteExt; start += 3; named = false; checksum = false; dataSize = 24; break;
+            default: return 0;
+        }
+        
+        int dataStart = start + (named ? 16 : 0);
+        int size = dataStart + dataSize + (checksum ? 1 : 0);
+        if (len < size)
+            return 0;
+        
+        unsigned char statusBits = 0;
+        for (int i = 1; i < size; i++)
+            statusBits |= buffer[i];
+        if (statusBits & 0x80)
+            return 0;
+        
+        if (named)
+        {
+            for (int i = 0; i < 16; i++)
+                pendingName[i] = static_cast<char>(buffer[start + i]);
+            pendingName[16] = '\0';
+        }
+        
+        const unsigned char *data = buffer + dataStart;
+        
+        if (messageFormat == eBulk)
+        {
+            int retuneNotes[128];
+            double detunes[128];
+            for (int i = 0; i < 128; i++)
+            {
+                retuneNotes[i] = data[3 * i];
+                detunes[i] = ((data[3 * i + 1] << 7) | data[3 * i + 2]) / 16383.0;
+            }
+            for (int i = 0; i < 128; i++)
+                pendingFreqs[i] = global.et[retuneNotes[i]] * semitoneRatio(detunes[i]);
+            
+            if (retuneNotes[127] == 0 && data[382] == 0x7F && data[383] == 0x7F) // no change, as in the state machine
+                pendingFreqs[127] = localFreqs[127];
+        }
+        else
+        {
+            double ratios[12];
+            for (int i = 0; i < 12; i++)
+            {
+                double detune;
+                if (messageFormat == eScaleOctOneByte || messageFormat == eScaleOctOneByteExt)
+                {
+                    detune = (static_cast<double>(data[i]) - 64.0) * 0.01;
+                }
+                else
+                {
+                    int value = (data[2 * i] << 7) | data[2 * i + 1];
+                    detune = (static_cast<double>(value) - 8192.0) / (value > 8192 ? 8191.0 : 8192.0);
+                }
+                ratios[i] = semitoneRatio(detune);
+            }
+            for (int i = 0; i < 128; i++)
+                pendingFreqs[i] = global.et[i] * ratios[i % 12];
+        }
+        
+        applyTuning(messageFormat);
+        return size;
     }
     
+    // Parsing state is kept between calls, so messages may be split across any number of buffers. Tuning data is
+    // collected in pendingFreqs and only applied once a message is complete, so an incomplete message changes nothing.
     inline void parseMIDIData(const unsigned char *buffer, int len)
     {
-        int sysex_ctr = 0;
-        int sysex_value = 0;
-        int note = 0;
-        int numTunings = 0;
         /*int bank = -1, prog = 0, checksum = 0, deviceID = 0; short int channelBitmap = 0; bool realtime = false;*/ // unused for now
         
-        eSysexState state = eIgnoring;
-        eMTSFormat format = eBulk;
+        if (len > 0)
+            count(eDiagSysExBytes, static_cast<unsigned int>(len));
+        
         for (int i = 0; i < len; i++)
         {
             unsigned char b = buffer[i];
             if (b == 0xF7)
             {
-                state = eIgnoring;
+                sysexState = eIgnoring;
                 continue;
             }
             
+            if (sysexState == eIgnoring && b == 0xF0)
+            {
+                int size = decodeMessage(buffer + i, len - i);
+                if (size > 0)
+                {
+                    i += size - 1;
+                    continue;
+                }
+            }
+            
             if (b > 0x7F && b != 0xF0)
                 continue;
             
-            switch (state)
+            switch (sysexState)
             {
                 case eIgnoring:
                     if (b == 0xF0)
-                        state = eMatchingSysex;
+                        sysexState = eMatchingSysex;
                     break;
                 case eMatchingSysex:
-                    sysex_ctr = 0;
+                    sysexCtr = 0;
                     if (b == 0x7E)
-                        state = eSysexValid;
+                        sysexState = eSysexValid;
                     else if (b == 0x7F)
                     {
                         /*realtime = true;*/
-                        state = eSysexValid;
+                        sysexState = eSysexValid;
                     }
                     else 
                     {
-                        state = eIgnoring;
+                        sysexState = eIgnoring;
                     }
                     break;
                 case eSysexValid:
-                    switch (sysex_ctr++) // handle device ID
+                    switch (sysexCtr++) // handle device ID
                     {
                         case 0:
                             /*deviceID = b;*/
                             break;
                         case 1: 
                             if (b == 0x08)
-                                state = eMatchingMTS;
+                                sysexState = eMatchingMTS;
                             break;
                         default: // it's not an MTS message
-                            state = eIgnoring;
+                            sysexState = eIgnoring;
                             break;
                     }
                     break;
                 case eMatchingMTS:
-                    sysex_ctr = 0;
+                    sysexCtr = 0;
                     switch (b)
                     {
                         case 0: 
-                            format = eRequest;
-                            state = eMatchingProg;
+                            sysexFormat = eRequest;
+                            sysexState = eMatchingProg;
                             break;
                         case 1: 
-                            format = eBulk;
-                            state = eMatchingProg;
+                            sysexFormat = eBulk;
+                            sysexState = eMatchingProg;
                             break;
                         case 2: 
-                            format = eSingle;
-                            state = eMatchingProg;
+                            sysexFormat = eSingle;
+                            sysexState = eMatchingProg;
                             break;
                         case 3: 
-                            format = eRequest; 
-                            state = eMatchingBank; 
+                            sysexFormat = eRequest; 
+                            sysexState = eMatchingBank; 
                             break;
                         case 4:
-                            format = eBulk; 
-                            state = eMatchingBank; 
+                            sysexFormat = eBulk; 
+                            sysexState = eMatchingBank; 
                             break;
                         case 5:
-                            format = eScaleOctOneByte; 
-                            state = eMatchingBank; 
+                            sysexFormat = eScaleOctOneByte; 
+                            sysexState = eMatchingBank; 
                             break;
                         case 6:
-                            format = eScaleOctTwoByte; 
-                            state = eMatchingBank; 
+                            sysexFormat = eScaleOctTwoByte; 
+                            sysexState = eMatchingBank; 
                             break;
                         case 7:
-                            format = eSingle; 
-                            state = eMatchingBank; 
+                            sysexFormat = eSingle; 
+                            sysexState = eMatchingBank; 
                             break;
                         case 8:
-                            format = eScaleOctOneByteExt; 
-                            state = eMatchingChannel; 
+                            sysexFormat = eScaleOctOneByteExt; 
+                            sysexState = eMatchingChannel; 
                             break;
                         case 9:
-                            format = eScaleOctTwoByteExt; 
-                            state = eMatchingChannel; 
+                            sysexFormat = eScaleOctTwoByteExt; 
+                            sysexState = eMatchingChannel; 
                             break;
                         default: // it's not a valid MTS format
-                            state = eIgnoring;
+                            sysexState = eIgnoring;
                             break;
                     }
                     break;
                 case eMatchingBank:
                     /*bank = b;*/
-                    state = eMatchingProg;
+                    sysexState = eMatchingProg;
                     break;
                 case eMatchingProg:
                     /*prog = b;*/
-                    if (format == eSingle)
+                    if (sysexFormat == eSingle)
                     {
-                        state = eNumTunings;
+                        sysexState = eNumTunings;
                     }
                     else
                     {
-                        state = eTuningName;
-                        tuningName[0] = '\0';
+                        sysexState = eTuningName;
+                        pendingName[0] = '\0';
                     }
                     break;
                 case eTuningName:
-                    tuningName[sysex_ctr] = static_cast<char>(b);
-                    if (++sysex_ctr >= 16)
+                    pendingName[sysexCtr] = static_cast<char>(b);
+                    if (++sysexCtr >= 16)
                     {
-                        tuningName[16] = '\0';
-                        sysex_ctr = 0;
-                        state = eTuningData;
+                        pendingName[16] = '\0';
+                        beginTuningData();
                     }
                     break;
                 case eNumTunings:
-                    numTunings = b;
-                    sysex_ctr = 0;
-                    state = eTuningData;
+                    sysexNumTunings = b;
+                    beginTuningData();
                     break;
                 case eMatchingChannel:
-                    switch (sysex_ctr++)
+                    switch (sysexCtr++)
                     {
                         case 0: 
                             /*for (int j = 14; j < 16; j++) channelBitmap |= (1 << j);*/
@@ -737,71 +1895,113 @@ struct MTSClient
                             break;
                         case 2: 
                             /*for (int j = 0; j < 7; j++) channelBitmap |= (1 << j);*/
-                            sysex_ctr = 0;
-                            state = eTuningData;
+                            beginTuningData();
                             break;
                     }
                     break;
                 case eTuningData:
-                    switch (format)
+                    switch (sysexFormat)
                     {
                         case eBulk:
-                            sysex_value = (sysex_value << 7) | b;
-                            sysex_ctr++;
-                            if ((sysex_ctr & 3) == 3)
+                            sysexValue = (sysexValue << 7) | b;
+                            sysexCtr++;
+                            if ((sysexCtr & 3) == 3)
                             {
-                                if (!(note == 0x7F && sysex_value == 16383))
-                                    updateTuning(note, (sysex_value >> 14) & 127, (sysex_value & 16383) / 16383.0);
-                                sysex_value = 0;
-                                sysex_ctr++;
-                                if (++note >= 128)
-                                    state = eCheckSum;
+                                if (!(sysexNote == 0x7F && sysexValue == 16383))
+                                    updateTuning(sysexNote, (sysexValue >> 14) & 127, (sysexValue & 16383) / 16383.0);
+                                sysexValue = 0;
+                                sysexCtr++;
+                                if (++sysexNote >= 128)
+                                {
+                                    sysexState = eCheckSum;
+                                    applyTuning(sysexFormat);
+                                }
                             }
                             break;
                         case eSingle:
-                            sysex_value = (sysex_value << 7) | b;
-                            sysex_ctr++;
-                            if (!(sysex_ctr & 3))
+                            sysexValue = (sysexValue << 7) | b;
+                            sysexCtr++;
+                            if (!(sysexCtr & 3))
                             {
-                                if (!(note == 0x7F && sysex_value == 16383))
-                                    updateTuning((sysex_value >> 21) & 127, (sysex_value >> 14) & 127, (sysex_value & 16383) / 16383.0);
-                                sysex_value = 0;
-                                if (++note >= numTunings)
-                                    state = eIgnoring;
+                                if (!(sysexNote == 0x7F && sysexValue == 16383))
+                                    updateTuning((sysexValue >> 21) & 127, (sysexValue >> 14) & 127, (sysexValue & 16383) / 16383.0);
+                                sysexValue = 0;
+                                if (++sysexNote >= sysexNumTunings)
+                                {
+                                    sysexState = eIgnoring;
+                                    applyTuning(sysexFormat);
+                                }
                             }
                             break;
                         case eScaleOctOneByte: 
                         case eScaleOctOneByteExt:
-                            for (int j = sysex_ctr; j < 128; j += 12)
+                            for (int j = sysexCtr; j < 128; j += 12)
                                 updateTuning(j, j, (static_cast<double>(b) - 64.0) * 0.01);
-                            if (++sysex_ctr >= 12)
-                                state = format == eScaleOctOneByte ? eCheckSum : eIgnoring;
+                            if (++sysexCtr >= 12)
+                            {
+                                sysexState = sysexFormat == eScaleOctOneByte ? eCheckSum : eIgnoring;
+                                applyTuning(sysexFormat);
+                            }
                             break;
                         case eScaleOctTwoByte: 
                         case eScaleOctTwoByteExt:
-                            sysex_value = (sysex_value << 7) | b;
-                            sysex_ctr++;
-                            if (!(sysex_ctr & 1))
+                            sysexValue = (sysexValue << 7) | b;
+                            sysexCtr++;
+                            if (!(sysexCtr & 1))
                             {
-                                double detune = (static_cast<double>(sysex_value & 16383) - 8192.0) / (sysex_value > 8192 ? 8191.0 : 8192.0);
-                                for (int j = note; j < 128; j += 12)
+                                double detune = (static_cast<double>(sysexValue & 16383) - 8192.0) / (sysexValue > 8192 ? 8191.0 : 8192.0);
+                                for (int j = sysexNote; j < 128; j += 12)
                                     updateTuning(j, j, detune);
-                                if (++note >= 12)
-                                    state = format == eScaleOctTwoByte ? eCheckSum : eIgnoring;
+                                sysexValue = 0;
+                                if (++sysexNote >= 12)
+                                {
+                                    sysexState = sysexFormat == eScaleOctTwoByte ? eCheckSum : eIgnoring;
+                                    applyTuning(sysexFormat);
+                                }
                             }
                             break;
                         default: 
-                            state = eIgnoring;
+                            sysexState = eIgnoring;
                             break;
                     }
                     break;
                 case eCheckSum:
                     /*checksum = b;*/
-                    state = eIgnoring;
+                    sysexState = eIgnoring;
                     break;
             }
         }
         
+        if (localTuningChanged)
+        {
+            localTuningChanged = false;
+            localTunings.set(localFreqs);
+            localTuningCount++;
+            if (!wasOnline)
+                generation++;
+        }
+    }
+    
+    inline void beginTuningData()
+    {
+        for (int i = 0; i < 128; i++)
+            pendingFreqs[i] = localFreqs[i];
+        sysexCtr = 0;
+        sysexValue = 0;
+        sysexNote = 0;
+        sysexState = eTuningData;
+    }
+    
+    // Called when the tuning data of a message has been received in full.
+    inline void applyTuning(eMTSFormat format)
+    {
+        for (int i = 0; i < 128; i++)
+            setLocalFreq(i, pendingFreqs[i]);
+        
+        if (format == eBulk || format == eScaleOctOneByte || format == eScaleOctTwoByte)
+            for (int i = 0; i < 17; i++)
+                tuningName[i] = pendingName[i];
+        
         if (format == eScaleOctOneByte || format == eScaleOctTwoByte || format == eScaleOctOneByteExt || format == eScaleOctTwoByteExt)
         {
             mapSizeLocal = static_cast<signed char>(12);
@@ -818,20 +2018,259 @@ struct MTSClient
     {
         if (note < 0 || note > 127 || retuneNote < 0 || retuneNote > 127)
             return;
+        pendingFreqs[note] = global.et[retuneNote] * semitoneRatio(detune);
+    }
+    
+    inline void setLocalFreq(int note, double freq)
+    {
         receivedMTSSysEx = true;
-        localFreqs[note] = 440.0 * pow(2.0, ((retuneNote + detune) - 69.0) / 12.0);
-        if (localFreqs[note] != localTunings[note].freq)
+        if (freq != localFreqs[note])
         {
-            localTunings[note].freq = localFreqs[note];
-            localTunings[note].flags = 0;
+            localFreqs[note] = freq;
+            localTuningChanged = true;
         }
     }
     
     inline bool hasReceivedMTSSysEx() {return receivedMTSSysEx;}
     
-    const char *getScaleName() {return (global.isOnline() && global.GetScaleName) ? global.GetScaleName() : tuningName;}
+    // Changes whenever the tuning or note filtering seen by this client may have changed: when the master updates
+    // them, when connecting to or disconnecting from a master, or when local tuning is updated via MTS SysEx.
+    // If libMTS is too old to count changes, changes made by the master can't be detected, so whilst connected this
+    // only changes on connecting.
+    inline unsigned int tuningGeneration()
+    {
+        bool online = updateGeneration();
+        return online && !global.GetTuningGeneration ? onlineGeneration : generation;
+    }
+    
+    // The generation the client's own tables and indices are built for. If libMTS is too old to count changes, a new
+    // value is returned on every call whilst connected, so they are rebuilt whenever used.
+    inline unsigned int cacheGeneration()
+    {
+        bool online = updateGeneration();
+        return online && !global.GetTuningGeneration ? ++generation : generation;
+    }
+    
+    // Brings the generation up to date with the connection status and the generation counter of libMTS, returning
+    // whether the client is connected to a master.
+    inline bool updateGeneration()
+    {
+        bool online = slot->isOnline();
+        if (online != wasOnline)
+        {
+            wasOnline = online;
+            onlineGeneration = ++generation;
+        }
+        
+        if (online && global.GetTuningGeneration)
+        {
+            unsigned int g = slot->getTuningGeneration();
+            if (g != libGeneration)
+            {
+                libGeneration = g;
+                generation++;
+            }
+        }
+        
+        return online;
+    }
+    
+    // Fills the arrays with the notes retuned by the master since the previous call, returning how many, or -1 if every
+    // note must be re-queried: on the first call, on connecting to or disconnecting from a master, when local tuning has
+    // been updated via MTS SysEx, and whenever libMTS can't list the changes.
+    inline int tuningChanges(char *midinotes, signed char *midichannels, double *freqs, int maxChanges)
+    {
+        bool online = slot->isOnline();
+        bool allChanged = !changesValid || online != changesOnline;
+        changesValid = true;
+        changesOnline = online;
+        
+        if (!online)
+        {
+            allChanged = allChanged || localTuningCount != changesLocalTuningCount;
+            changesLocalTuningCount = localTuningCount;
+            return allChanged ? -1 : 0;
+        }
+        
+        if (!global.GetTuningChanges)
+            return -1;
+        
+        int numChanges = slot->getTuningChanges(changesGeneration, &changesGeneration, midinotes, midichannels, freqs, maxChanges);
+        return allChanged ? -1 : numChanges;
+    }
+    
+    // Changes scheduled by the master are only reported whilst connected, as they are applied to the tables by the master.
+    inline int scheduledTuningChanges(double blockStart, int blockLength, int *offsets, char *midinotes, signed char *midichannels, double *freqs, int maxChanges)
+    {
+        if (!global.GetScheduledTuningChanges || !slot->isOnline())
+            return 0;
+        return slot->getScheduledTuningChanges(blockStart, blockLength, offsets, midinotes, midichannels, freqs, maxChanges);
+    }
+    
+    // bendRange is the retuning in semitones at either end of the pitch bend range. Output channels rotate through
+    // [firstChannel, firstChannel + numChannels), e.g. the member channels of an MPE zone.
+    inline void setPitchBendOutput(double bendRange, signed char firstChannel, signed char numChannels)
+    {
+        if (bendRange > 0.0 && bendRange != pitchBendRange)
+        {
+            pitchBendRange = bendRange;
+            for (int i = 0; i < 17; i++)
+                if (pitchBendTables[i])
+                    pitchBendTables[i]->valid = false;
+        }
+        
+        pitchBendFirstChannel = firstChannel & 15;
+        pitchBendNumChannels = std::max(1, std::min(static_cast<int>(numChannels), 16 - pitchBendFirstChannel));
+        pitchBendNextChannel = 0;
+        for (int i = 0; i < 16; i++)
+            pitchBendChannelNotes[i] = 0;
+    }
+    
+    // Returns the table for a MIDI channel argument, rebuilt from a snapshot of the tuning if the generation has changed.
+    inline const mtspitchbendtable &pitchBendTable(signed char midichannel)
+    {
+        int i = !(midichannel & ~15) ? midichannel : 16;
+        if (!pitchBendTables[i])
+            pitchBendTables[i] = new mtspitchbendtable;
+        
+        mtspitchbendtable &table = *pitchBendTables[i];
+        unsigned int gen = cacheGeneration();
+        if (!table.valid || table.generation != gen)
+        {
+            double freqs[128];
+            tuningSnapshot(freqs, midichannel);
+            table.build(freqs, pitchBendRange);
+            table.generation = gen;
+            table.valid = true;
+        }
+        return table;
+    }
+    
+    // Takes the next output channel in turn that has no held notes, or the next in turn if all have held notes.
+    inline int takePitchBendChannel()
+    {
+        int channel = pitchBendFirstChannel + pitchBendNextChannel;
+        for (int i = 0; i < pitchBendNumChannels; i++)
+        {
+            int c = pitchBendFirstChannel + (pitchBendNextChannel + i) % pitchBendNumChannels;
+            if (!pitchBendChannelNotes[c])
+            {
+                channel = c;
+                break;
+            }
+        }
+        pitchBendNextChannel = (channel - pitchBendFirstChannel + 1) % pitchBendNumChannels;
+        pitchBendChannelNotes[channel]++;
+        return channel;
+    }
+    
+    // With a libMTS too old to count changes the table would be rebuilt on every call, so only the note converted is.
+    inline void noteToPitchBend(char midinote, signed char midichannel, char *outNote, signed char *outChannel, int *pitchBend)
+    {
+        int note = midinote & 127;
+        char n;
+        short bend;
+        if (slot->isOnline() && !global.GetTuningGeneration)
+        {
+            mtspitchbendtable::convert(freq(midinote, midichannel), note, pitchBendRange, n, bend);
+        }
+        else
+        {
+            const mtspitchbendtable &table = pitchBendTable(midichannel);
+            n = table.note[note];
+            bend = table.bend[note];
+        }
+        
+        if (outNote)
+            *outNote = n;
+        if (pitchBend)
+            *pitchBend = bend;
+        if (outChannel)
+            *outChannel = static_cast<signed char>(takePitchBendChannel());
+    }
+    
+    inline void releasePitchBendChannel(signed char outChannel)
+    {
+        if (!(outChannel & ~15) && pitchBendChannelNotes[outChannel] > 0)
+            pitchBendChannelNotes[outChannel]--;
+    }
+    
+    // Returns the frequency of every key, (midichannel << 7) | midinote, as freq() would for that note and channel,
+    // rebuilt whenever the tuning generation changes. Every table is copied under one read of the sequence lock, so the
+    // keys are never a mix of tuning from before and after a master update. If the master is writing throughout, the
+    // previous snapshot of each table is used and the key table is rebuilt on the next call.
+    inline const double *keyTable()
+    {
+        freqRequestReceived = true;
+        supportsMultiChannelTuning = true;
+        
+        if (!keyFreqs)
+            keyFreqs = new mtskeytable;
+        
+        mtskeytable &table = *keyFreqs;
+        unsigned int gen = cacheGeneration();
+        if (table.valid && table.generation == gen)
+            return table.freq;
+        
+        count(eDiagTableRefreshes);
+        bool online = slot->isOnline();
+        bool multiChannelAllowed = online && (!supportsNoteFiltering || supportsMultiChannelNoteFiltering);
+        
+        const double *srcs[16];
+        const mtstuningtable *snapshots[16];
+        for (int i = 0; i < 16; i++)
+        {
+            srcs[i] = localTunings.freq;
+            snapshots[i] = &localTunings;
+            if (multiChannelAllowed && slot->multi_channel_esp_retuning[i] && slot->useMultiChannelTuning(static_cast<signed char>(i)))
+            {
+                srcs[i] = slot->multi_channel_esp_retuning[i];
+                snapshots[i] = &slot->globalMultichannelTunings[i];
+            }
+            else if (online)
+            {
+                srcs[i] = slot->esp_retuning;
+                snapshots[i] = &slot->globalTunings;
+            }
+        }
+        
+        table.valid = slot->readTables(table.freq, srcs, 16);
+        if (!table.valid)
+            for (int i = 0; i < 16; i++)
+                if (!snapshots[i]->readFreqs(table.freq + i * 128))
+                    for (int j = 0; j < 128; j++)
+                        table.freq[i * 128 + j] = srcs[i][j];
+        
+        table.generation = gen;
+        return table.freq;
+    }
+    
+    // With a libMTS too old to count changes the key table would be rebuilt on every call, so single keys are looked up
+    // in the table for their note and channel instead.
+    inline double keyFreq(int key)
+    {
+        key &= mtskeytable::eNumKeys - 1;
+        if (slot->isOnline() && !global.GetTuningGeneration)
+            return freq(static_cast<char>(key & 127), static_cast<signed char>(key >> 7));
+        count(eDiagFrequencyQueries);
+        return keyTable()[key];
+    }
+    
+    inline void keysToFreqs(const int *keys, double *freqs, int numKeys)
+    {
+        if (!keys || !freqs || numKeys <= 0)
+            return;
+        
+        count(eDiagBatchQueries);
+        count(eDiagBatchNotes, static_cast<unsigned int>(numKeys));
+        const double *table = keyTable();
+        for (int i = 0; i < numKeys; i++)
+            freqs[i] = table[keys[i] & (mtskeytable::eNumKeys - 1)];
+    }
+    
+    const char *getScaleName() {return (slot->isOnline() && global.GetScaleName) ? slot->getScaleName() : tuningName;}
     
-    double getPeriodRatio() {return (global.isOnline() && global.GetPeriodRatio) ? global.GetPeriodRatio() : 2.0;}
+    double getPeriodRatio() {return (slot->isOnline() && global.GetPeriodRatio) ? slot->getPeriodRatio() : 2.0;}
     double getPeriodSemitones()
     {
         double periodRatio = getPeriodRatio();
@@ -843,20 +2282,36 @@ struct MTSClient
         return periodSemitones;
     }
     
-    signed char getMapSize() {return (global.isOnline() && global.GetMapSize) ? global.GetMapSize() : mapSizeLocal;}
-    signed char getMapStartKey() {return (global.isOnline() && global.GetMapStartKey) ? global.GetMapStartKey() : mapStartKeyLocal;}
-    signed char getRefKey() {return (global.isOnline() && global.GetRefKey) ? global.GetRefKey() : static_cast<signed char>(-1);}
+    signed char getMapSize() {return (slot->isOnline() && global.GetMapSize) ? slot->getMapSize() : mapSizeLocal;}
+    signed char getMapStartKey() {return (slot->isOnline() && global.GetMapStartKey) ? slot->getMapStartKey() : mapStartKeyLocal;}
+    signed char getRefKey() {return (slot->isOnline() && global.GetRefKey) ? slot->getRefKey() : static_cast<signed char>(-1);}
+    
+    // Binding to a different slot is seen by the client as a change of tuning, as if the master had changed it.
+    inline bool bindSlot(int index)
+    {
+        mtsclientslot *s = global.slot(index);
+        if (!s)
+            return false;
+        if (s != slot)
+        {
+            slot = s;
+            generation++;
+            changesValid = false;
+        }
+        return true;
+    }
+    
+    mtsclientslot *slot; // resolved once by bindSlot(), so queries cost the same in every slot
     
-    enum eSysexState {eIgnoring = 0, eMatchingSysex, eSysexValid, eMatchingMTS, eMatchingBank, eMatchingProg, eMatchingChannel, eTuningName, eNumTunings, eTuningData, eCheckSum};
-    enum eMTSFormat {eRequest = 0, eBulk, eSingle, eScaleOctOneByte, eScaleOctTwoByte, eScaleOctOneByteExt, eScaleOctTwoByteExt};
-
     double localFreqs[128];
-    Tuning localTunings[128];
-    Tuning globalTunings[128];
-    Tuning globalMultichannelTunings[16][128];
+    mtstuningtable localTunings;
     
     char tuningName[17];
     
+    // Received via MTS SysEx, copied to localFreqs and tuningName once a message is complete
+    double pendingFreqs[128];
+    char pendingName[17];
+    
     double periodRatioLocal;
     double periodSemitones;
     
@@ -868,6 +2323,42 @@ struct MTSClient
     bool supportsMultiChannelTuning;
     bool freqRequestReceived;
     bool receivedMTSSysEx;
+    bool localTuningChanged;
+    
+    bool wasOnline;
+    unsigned int libGeneration;
+    unsigned int generation;
+    unsigned int onlineGeneration; // generation on connecting to a master, returned whilst libMTS can't count changes
+    unsigned int waitGeneration; // only accessed by the thread calling waitForTuningChange()
+    
+    unsigned int localTuningCount;
+    unsigned int changesLocalTuningCount;
+    unsigned int changesGeneration;
+    bool changesOnline;
+    bool changesValid;
+    
+    // MTS SysEx parsing state, kept between calls to parseMIDIData()
+    eSysexState sysexState;
+    eMTSFormat sysexFormat;
+    int sysexCtr;
+    int sysexValue;
+    int sysexNote;
+    int sysexNumTunings;
+    
+    mtsnoteindex *noteIndices[eNumNoteIndices];
+    
+    unsigned int *diagnostics; // counters in libMTS, claimed when the client registers
+    unsigned int diagnosticsUnavailableFlag; // value of the diagnostics flag when no entry was free
+    
+    // Pitch bend output: one table per MIDI channel argument, then one for no channel, and the output channels in use
+    mtspitchbendtable *pitchBendTables[17];
+    double pitchBendRange;
+    int pitchBendFirstChannel;
+    int pitchBendNumChannels;
+    int pitchBendNextChannel;
+    int pitchBendChannelNotes[16];
+    
+    mtskeytable *keyFreqs;
 };
 
 static char freqToNoteET(double freq)
@@ -887,14 +2378,21 @@ static char freqToNoteET(double freq)
 }
 
 // exported functions:
-MTSClient* MTS_RegisterClient()                                                         {return new MTSClient;}
+MTSClient* MTS_RegisterClient()                                                         {global.load(); return new MTSClient;}
 void MTS_DeregisterClient(MTSClient *c)                                                 {delete c;}
 bool MTS_HasMaster(MTSClient *c)                                                        {return c ? c->hasMaster() : false;}
 bool MTS_Client_ShouldUpdateLibrary(MTSClient *c)                                       {return c ? c->shouldUpdateLibrary() : false;}
+bool MTS_Client_SetLibraryLookup(void *(*lookup)(const char *name))                     {return mtslibrary::setLookup(lookup);}
+bool MTS_BindClientToSlot(MTSClient *c, int slot)                                       {return c ? c->bindSlot(slot) : false;}
 bool MTS_ShouldFilterNote(MTSClient *c, char midinote, signed char midichannel)         {return c ? c->shouldFilterNote(midinote & 127, midichannel) : false;}
+void MTS_GetNoteFilterMask(MTSClient *c, signed char midichannel, unsigned int *mask)   {if (c && mask) c->noteFilterMask(midichannel, mask); else if (mask) mask[0] = mask[1] = mask[2] = mask[3] = 0;}
 double MTS_NoteToFrequency(MTSClient *c, char midinote, signed char midichannel)        {return c ? c->freq(midinote, midichannel) : (1.0 / global.iet[midinote & 127]);}
 double MTS_RetuningAsRatio(MTSClient *c, char midinote, signed char midichannel)        {return c ? c->ratio(midinote, midichannel) : 1.0;}
 double MTS_RetuningInSemitones(MTSClient *c, char midinote, signed char midichannel)    {return c ? c->semitones(midinote, midichannel) : 0.0;}
+float MTS_NoteToFrequencyFloat(MTSClient *c, char midinote, signed char midichannel)    {return c ? c->query(&mtstuningtable::freqFloat, midinote, midichannel) : static_cast<float>(1.0 / global.iet[midinote & 127]);}
+float MTS_RetuningAsRatioFloat(MTSClient *c, char midinote, signed char midichannel)    {return c ? c->query(&mtstuningtable::ratioFloat, midinote, midichannel) : 1.f;}
+float MTS_RetuningInSemitonesFloat(MTSClient *c, char midinote, signed char midichannel) {return c ? c->query(&mtstuningtable::semitonesFloat, midinote, midichannel) : 0.f;}
+int MTS_RetuningInCentsQ16(MTSClient *c, char midinote, signed char midichannel)        {return c ? c->query(&mtstuningtable::centsQ16, midinote, midichannel) : 0;}
 char MTS_FrequencyToNote(MTSClient *c, double freq, signed char midichannel)            {return c ? c->freqToNote(freq, midichannel) : freqToNoteET(freq);}
 char MTS_FrequencyToNoteAndChannel(MTSClient *c, double freq, signed char *midichannel) {if (c) return c->freqToNote(freq, midichannel); if (midichannel) *midichannel = 0; return freqToNoteET(freq);}
 const char *MTS_GetScaleName(MTSClient *c)                                              {return c ? c->getScaleName() : "";}
@@ -906,3 +2404,137 @@ signed char MTS_GetRefKey(MTSClient *c)
 void MTS_ParseMIDIDataU(MTSClient *c, const unsigned char *buffer, int len)             {if (c) c->parseMIDIData(buffer, len);}
 void MTS_ParseMIDIData(MTSClient *c, const signed char *buffer, int len)                {if (c) c->parseMIDIData(reinterpret_cast<const unsigned char*>(buffer), len);}
 bool MTS_HasReceivedMTSSysEx(MTSClient *c)                                              {return c ? c->hasReceivedMTSSysEx() : false;}
+unsigned int MTS_GetTuningGeneration(MTSClient *c)                                      {return c ? c->tuningGeneration() : 0;}
+bool MTS_WaitForTuningChange(MTSClient *c, int timeoutMs)                               {return c ? c->waitForTuningChange(timeoutMs) : false;}
+double MTS_KeyToFrequency(MTSClient *c, int key)                                        {return c ? c->keyFreq(key) : (1.0 / global.iet[key & 127]);}
+const double *MTS_GetKeyFrequencies(MTSClient *c)                                       {return c ? c->keyTable() : 0;}
+
+void MTS_GetTuningSnapshot(MTSClient *c, double *freqs, signed char midichannel)
+{
+    if (c)
+        c->tuningSnapshot(freqs, midichannel);
+    else if (freqs)
+        for (int i = 0; i < 128; i++)
+            freqs[i] = 1.0 / global.iet[i];
+}
+
+int MTS_GetTuningChanges(MTSClient *c, char *midinotes, signed char *midichannels, double *freqs, int maxChanges)
+{
+    return c ? c->tuningChanges(midinotes, midichannels, freqs, maxChanges) : -1;
+}
+
+void MTS_SetPitchBendOutput(MTSClient *c, double bendRange, signed char firstChannel, signed char numChannels)
+{
+    if (c)
+        c->setPitchBendOutput(bendRange, firstChannel, numChannels);
+}
+
+void MTS_NoteToPitchBend(MTSClient *c, char midinote, signed char midichannel, char *outNote, signed char *outChannel, int *pitchBend)
+{
+    if (c)
+    {
+        c->noteToPitchBend(midinote, midichannel, outNote, outChannel, pitchBend);
+        return;
+    }
+    if (outNote)
+        *outNote = static_cast<char>(midinote & 127);
+    if (outChannel)
+        *outChannel = !(midichannel & ~15) ? midichannel : static_cast<signed char>(0);
+    if (pitchBend)
+        *pitchBend = 8192;
+}
+
+void MTS_ReleasePitchBendChannel(MTSClient *c, signed char outChannel)
+{
+    if (c)
+        c->releasePitchBendChannel(outChannel);
+}
+
+int MTS_GetScheduledTuningChanges(MTSClient *c, double blockStart, int blockLength, int *offsets, char *midinotes, signed char *midichannels, double *freqs, int maxChanges)
+{
+    return c ? c->scheduledTuningChanges(blockStart, blockLength, offsets, midinotes, midichannels, freqs, maxChanges) : 0;
+}
+
+void MTS_FrequenciesToNotesAndChannels(MTSClient *c, const double *freqs, char *midinotes, signed char *midichannels, int num)
+{
+    if (c)
+        c->freqsToNotes(freqs, midinotes, midichannels, num);
+    else if (freqs && midinotes && midichannels)
+        for (int i = 0; i < num; i++)
+        {
+            midinotes[i] = freqToNoteET(freqs[i]);
+            midichannels[i] = 0;
+        }
+}
+
+void MTS_NoteToFrequencies(MTSClient *c, const char *midinotes, const signed char *midichannels, double *freqs, int numNotes)
+{
+    if (c)
+        c->batchQuery(&mtstuningtable::freq, midinotes, midichannels, freqs, numNotes);
+    else if (midinotes && freqs)
+        for (int i = 0; i < numNotes; i++)
+            freqs[i] = 1.0 / global.iet[midinotes[i] & 127];
+}
+
+void MTS_RetuningsAsRatios(MTSClient *c, const char *midinotes, const signed char *midichannels, double *ratios, int numNotes)
+{
+    if (c)
+        c->batchQuery(&mtstuningtable::ratio, midinotes, midichannels, ratios, numNotes);
+    else if (midinotes && ratios)
+        for (int i = 0; i < numNotes; i++)
+            ratios[i] = 1.0;
+}
+
+void MTS_RetuningsInSemitones(MTSClient *c, const char *midinotes, const signed char *midichannels, double *semitones, int numNotes)
+{
+    if (c)
+        c->batchQuery(&mtstuningtable::semitones, midinotes, midichannels, semitones, numNotes);
+    else if (midinotes && semitones)
+        for (int i = 0; i < numNotes; i++)
+            semitones[i] = 0.0;
+}
+
+void MTS_NoteToFrequenciesFloat(MTSClient *c, const char *midinotes, const signed char *midichannels, float *freqs, int numNotes)
+{
+    if (c)
+        c->batchQuery(&mtstuningtable::freqFloat, midinotes, midichannels, freqs, numNotes);
+    else if (midinotes && freqs)
+        for (int i = 0; i < numNotes; i++)
+            freqs[i] = static_cast<float>(1.0 / global.iet[midinotes[i] & 127]);
+}
+
+void MTS_RetuningsAsRatiosFloat(MTSClient *c, const char *midinotes, const signed char *midichannels, float *ratios, int numNotes)
+{
+    if (c)
+        c->batchQuery(&mtstuningtable::ratioFloat, midinotes, midichannels, ratios, numNotes);
+    else if (midinotes && ratios)
+        for (int i = 0; i < numNotes; i++)
+            ratios[i] = 1.f;
+}
+
+void MTS_RetuningsInSemitonesFloat(MTSClient *c, const char *midinotes, const signed char *midichannels, float *semitones, int numNotes)
+{
+    if (c)
+        c->batchQuery(&mtstuningtable::semitonesFloat, midinotes, midichannels, semitones, numNotes);
+    else if (midinotes && semitones)
+        for (int i = 0; i < numNotes; i++)
+            semitones[i] = 0.f;
+}
+
+void MTS_RetuningsInCentsQ16(MTSClient *c, const char *midinotes, const signed char *midichannels, int *cents, int numNotes)
+{
+    if (c)
+        c->batchQuery(&mtstuningtable::centsQ16, midinotes, midichannels, cents, numNotes);
+    else if (midinotes && cents)
+        for (int i = 0; i < numNotes; i++)
+            cents[i] = 0;
+}
+
+void MTS_KeysToFrequencies(MTSClient *c, const int *keys, double *freqs, int numKeys)
+{
+    if (c)
+        c->keysToFreqs(keys, freqs, numKeys);
+    else if (keys && freqs)
+        for (int i = 0; i < numKeys; i++)
+            freqs[i] = 1.0 / global.iet[keys[i] & 127];
+}
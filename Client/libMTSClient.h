@@ -47,6 +47,14 @@ extern "C" {
      3. RECOMMENDED: Continuously query retuning whilst a note is held, allowing tuning to change
      along the flight of a note. Do this if you can and as often as possible, ideally at the same
      time as processing any other pitch modulation sources (envelopes, MIDI controllers, LFOs etc.).
+     If you process many voices per block, the batch versions query all voices with a single call:
+
+        MTS_RetuningsInSemitones(client, midinotes, midichannels, retune_semitones, num_voices);
+
+     To avoid re-querying every voice when nothing has changed, check once per block:
+
+        unsigned int generation = MTS_GetTuningGeneration(client);
+        if (generation != last_generation) {last_generation = generation; re-query held notes;}
 
      
      4. RECOMMENDED: Provide an option to the user to select whether tuning is queried at note-on
@@ -138,19 +146,76 @@ extern "C" {
     extern void MTS_DeregisterClient(MTSClient *client);
 
     // Check if the client is currently connected to a master plug-in.
+    // With a libMTS that publishes its connection flag, this and the connection check made by every other query are a single
+    // memory read, and a master registering or deregistering is seen by the very next query made after the master's call returns.
     extern bool MTS_HasMaster(MTSClient *client);
 
     // Check if the MTS-ESP dynamic library needs to be updated to use all features in this version of the API.
     extern bool MTS_Client_ShouldUpdateLibrary(MTSClient *client);
 
+    // Makes clients find each libMTS function by calling lookup with its name, e.g. "MTS_GetTuningTable", instead of opening
+    // the installed libMTS, so tests can run against stub functions. lookup returns null for functions it does not provide.
+    // Must be called before the first client registers, and also applies to the master functions if built into the same binary.
+    // Returns false if libMTS has already been opened. To load libMTS from another location instead, set the environment
+    // variable MTS_ESP_LIBRARY_PATH to the full path of the library, which is tried before the installed one.
+    extern bool MTS_Client_SetLibraryLookup(void *(*lookup)(const char *name));
+
+    // Binds the client to one of the tuning slots 0-15, each with its own master, e.g. one slot per instrument group. Clients
+    // start in slot 0, the slot used by masters that do not choose one. All queries then read the slot's tuning, at the same
+    // cost as in slot 0, as the slot is resolved here rather than on every query. Call from the same thread as queries, or
+    // whilst not querying, e.g. when the plugin loads or its slot setting changes. The tuning generation changes on binding
+    // to a different slot. Returns false, leaving the client in its previous slot, if the slot does not exist or libMTS is
+    // too old to support slots.
+    extern bool MTS_BindClientToSlot(MTSClient *client, int slot);
+
     // Returns true if note should not be played. MIDI channel argument should be included if possible (0-15), else set to -1.
     extern bool MTS_ShouldFilterNote(MTSClient *client, char midinote, signed char midichannel);
 
+    // Fills mask, four 32 bit words, with the result of MTS_ShouldFilterNote() for every note on a MIDI channel, where bit
+    // (note & 31) of mask[note >> 5] is set if the note should not be played. Useful to check all held or incoming notes at once.
+    extern void MTS_GetNoteFilterMask(MTSClient *client, signed char midichannel, unsigned int *mask);
+
     // Retuning a midi note. Pick the version that makes your life easiest! MIDI channel argument should be included if possible (0-15), else set to -1.
     extern double MTS_NoteToFrequency(MTSClient *client, char midinote, signed char midichannel);
     extern double MTS_RetuningInSemitones(MTSClient *client, char midinote, signed char midichannel);
     extern double MTS_RetuningAsRatio(MTSClient *client, char midinote, signed char midichannel);
     
+    // Copies the frequencies of all 128 MIDI notes into freqs, which must hold 128 elements. MIDI channel argument should be included if
+    // possible (0-15), else set to -1. With a libMTS that supports it, the copy is guaranteed to be taken either wholly before or wholly
+    // after any change made by the master, so notes of a chord are always retuned together. This never blocks: if the master is part way
+    // through a change, the last consistent table is returned instead. All retuning queries use such consistent copies internally.
+    extern void MTS_GetTuningSnapshot(MTSClient *client, double *freqs, signed char midichannel);
+    
+    // Batch versions of the above, for querying the retuning of many voices at once e.g. once per processing block.
+    // midinotes and the output array must contain numNotes elements. midichannels should also contain numNotes elements,
+    // or may be null if MIDI channels are not known, in which case -1 is used for every note.
+    // These are cheaper than calling the single-note versions in a loop, as connection status and multi-channel table use
+    // are only resolved once per call.
+    extern void MTS_NoteToFrequencies(MTSClient *client, const char *midinotes, const signed char *midichannels, double *freqs, int numNotes);
+    extern void MTS_RetuningsInSemitones(MTSClient *client, const char *midinotes, const signed char *midichannels, double *semitones, int numNotes);
+    extern void MTS_RetuningsAsRatios(MTSClient *client, const char *midinotes, const signed char *midichannels, double *ratios, int numNotes);
+    
+    // Single-precision and fixed-point versions of the above, for engines that don't process in double precision. Values are
+    // read from tables stored in these formats, so there is no conversion cost per query. MTS_RetuningInCentsQ16() returns the
+    // retuning in cents as Q16.16 fixed point, i.e. multiplied by 65536, which can be scaled to pitch bend by integer arithmetic.
+    extern float MTS_NoteToFrequencyFloat(MTSClient *client, char midinote, signed char midichannel);
+    extern float MTS_RetuningInSemitonesFloat(MTSClient *client, char midinote, signed char midichannel);
+    extern float MTS_RetuningAsRatioFloat(MTSClient *client, char midinote, signed char midichannel);
+    extern int MTS_RetuningInCentsQ16(MTSClient *client, char midinote, signed char midichannel);
+    extern void MTS_NoteToFrequenciesFloat(MTSClient *client, const char *midinotes, const signed char *midichannels, float *freqs, int numNotes);
+    extern void MTS_RetuningsInSemitonesFloat(MTSClient *client, const char *midinotes, const signed char *midichannels, float *semitones, int numNotes);
+    extern void MTS_RetuningsAsRatiosFloat(MTSClient *client, const char *midinotes, const signed char *midichannels, float *ratios, int numNotes);
+    extern void MTS_RetuningsInCentsQ16(MTSClient *client, const char *midinotes, const signed char *midichannels, int *cents, int numNotes);
+
+    // For controllers with more than 128 keys, e.g. isomorphic keyboards sending on several MIDI channels. Each key is given by
+    // a flat index, (midichannel << 7) | midinote, from 0 to 2047, and gives the same frequency as MTS_NoteToFrequency() with
+    // that note and channel. MTS_GetKeyFrequencies() returns all 2048 frequencies as one contiguous block aligned to a 64 byte
+    // cache line, e.g. for processing a whole controller with SIMD, valid until the next call to any of these functions for the
+    // client. The block is rebuilt only when the tuning generation changes. Call from one thread per client.
+    extern double MTS_KeyToFrequency(MTSClient *client, int key);
+    extern void MTS_KeysToFrequencies(MTSClient *client, const int *keys, double *freqs, int numKeys);
+    extern const double *MTS_GetKeyFrequencies(MTSClient *client);
+
     // MTS_FrequencyToNote() is a helper function returning the note number whose pitch is closest to the supplied frequency. Two versions are provided:
     // The first is for the simplest case: supply a frequency and get a note number back.
     // If you intend to use the returned note number to generate a note-on message on a specific, pre-determined MIDI channel, set the midichannel argument to the destination channel (0-15), else set to -1.
@@ -160,6 +225,13 @@ extern "C" {
     // The midichannel argument is a pointer to a char which will receive the MIDI channel on which the note message should be sent (0-15).
     // Multi-channel tuning tables are queried if in use.
     extern char MTS_FrequencyToNoteAndChannel(MTSClient *client, double freq, signed char *midichannel);
+    // Batch version of MTS_FrequencyToNoteAndChannel() for several simultaneous notes, e.g. partials found by polyphonic pitch detection.
+    // freqs, midinotes and midichannels must contain num elements. Each frequency is given the nearest note and channel not already given
+    // to another frequency in the same call, so that simultaneous notes don't collide, unless there are more frequencies than mapped notes.
+    extern void MTS_FrequenciesToNotesAndChannels(MTSClient *client, const double *freqs, char *midinotes, signed char *midichannels, int num);
+    // All versions use a sorted index of mapped notes which is rebuilt only when tuning or note filtering changes, so are
+    // cheap enough to call at audio rate. With an older libMTS that does not count tuning changes, the single-frequency versions search
+    // all notes on every call.
     
     // Returns the name of the current scale.
     extern const char *MTS_GetScaleName(MTSClient *client);
@@ -176,12 +248,65 @@ extern "C" {
     extern signed char MTS_GetRefKey(MTSClient *client);
 
     // Parse incoming MIDI data to update local tuning. All formats of MTS SysEx message accepted.
+    // Messages may be split across calls, e.g. when received in small buffers, without being copied into a whole message first.
+    // Tuning is only updated once a message has been received in full.
     extern void MTS_ParseMIDIDataU(MTSClient *client, const unsigned char *buffer, int len);
     extern void MTS_ParseMIDIData(MTSClient *client, const signed char *buffer, int len);
 
     // Check if the client has received any valid MTS SysEx messages and will use local tuning if not connected to a master plug-in.
     extern bool MTS_HasReceivedMTSSysEx(MTSClient *client);
 
+    // Returns a counter that changes whenever retuning or note filtering may have changed, including on connecting to or
+    // disconnecting from a master and on receiving MTS SysEx. Compare with the value from a previous call to skip re-querying
+    // held notes when nothing has changed. Values are only meaningful when compared with previous values from the same client.
+    // Detecting changes made by the master needs a libMTS that counts them. With an older libMTS the value only changes on
+    // connecting to or disconnecting from a master and on receiving MTS SysEx, so re-query held notes on every block
+    // whilst connected.
+    extern unsigned int MTS_GetTuningGeneration(MTSClient *client);
+
+    // Blocks the calling thread until the master changes tuning, note filtering or connection status, or until timeoutMs
+    // milliseconds have passed. Returns true if there was a change since the previous call. NEVER call this from the audio
+    // thread: it is intended for a background thread that wakes up the rest of the plug-in, e.g. in hosts running many
+    // sandboxed processes where checking every block is wasteful. Changes due to MTS SysEx received by the client are not reported.
+    // With an older libMTS this sleeps for the full timeout and always returns true.
+    extern bool MTS_WaitForTuningChange(MTSClient *client, int timeoutMs);
+
+    // Lists the notes retuned by the master since the previous call, so that only voices playing those notes need updating.
+    // midinotes, midichannels and freqs receive up to maxChanges entries, each note appearing once with its new frequency.
+    // A midichannel of -1 means the main tuning table changed, affecting every channel not using multi-channel tuning,
+    // otherwise it is the channel whose multi-channel table changed. Returns the number of entries, or -1 if all held notes
+    // must be re-queried, e.g. on the first call, on connecting to or disconnecting from a master, after receiving MTS SysEx,
+    // when a whole table or more than maxChanges notes changed, or with an older libMTS. Doesn't report changes to note
+    // filtering. Realtime safe, but call from only one thread per client, e.g. once per block before processing held notes.
+    extern int MTS_GetTuningChanges(MTSClient *client, char *midinotes, signed char *midichannels, double *freqs, int maxChanges);
+
+    // Lists the retunings the master has scheduled within a block, for applying them at the exact sample. blockStart is the
+    // sample position of the block's first sample on the host timeline and blockLength its number of samples. offsets,
+    // midinotes, midichannels and freqs receive up to maxChanges entries in time order, offsets being the sample within the
+    // block at which each note takes its new frequency. A change the master scheduled between samples takes effect at the
+    // nearest sample, rounding halves up, and is listed in the block holding that sample. midichannels are as for
+    // MTS_GetTuningChanges(). Any may be null.
+    // Returns the number of entries, or 0 if not connected to a master or with an older libMTS. Realtime safe.
+    // The tables, and so the other queries, change once the master applies the changes at the end of its own block. The
+    // host may process the master before the client, in which case the tables already hold the new frequency from the first
+    // sample of the block. So for a note with entries in a block, don't take its frequency from the other queries during that
+    // block: keep the frequency it had in the previous block up to the first entry's offset, then use each entry's frequency
+    // from its offset, and query the note as usual again from the next block.
+    extern int MTS_GetScheduledTuningChanges(MTSClient *client, double blockStart, int blockLength, int *offsets, char *midinotes, signed char *midichannels, double *freqs, int maxChanges);
+
+    // Optional converter for plug-ins sending MIDI to synths without MTS-ESP support, which retunes each note with pitch bend
+    // on a channel of its own, e.g. to an MPE synth. Set the synth's pitch bend range in semitones and the output channels
+    // to rotate through (0-15), by default a range of 48 semitones on channels 1-15, the member channels of an MPE lower zone.
+    extern void MTS_SetPitchBendOutput(MTSClient *client, double bendRange, signed char firstChannel, signed char numChannels);
+
+    // On note-on, gives the note, channel and 14 bit pitch bend (0-16383, centre 8192) to send for a note, retuned as by
+    // MTS_NoteToFrequency(). Send the pitch bend on the output channel before the note-on. Each output channel is taken
+    // until released with MTS_ReleasePitchBendChannel() on note-off, and channels still holding notes are only reused once
+    // every channel is taken. Results come from tables rebuilt only when the tuning changes, so this is cheap enough for
+    // every MIDI event. Call from one thread per client.
+    extern void MTS_NoteToPitchBend(MTSClient *client, char midinote, signed char midichannel, char *outNote, signed char *outChannel, int *pitchBend);
+    extern void MTS_ReleasePitchBendChannel(MTSClient *client, signed char outChannel);
+
 #ifdef __cplusplus
 }
 #endif
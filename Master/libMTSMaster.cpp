@@ -16,7 +16,11 @@ typedef HRESULT (WINAPI* SHGetKnownFolderPathFunc) (const GUID*, DWORD, HANDLE,
 typedef void (WINAPI* CoTaskMemFreeFunc) (LPVOID);
 #else
 #include <dlfcn.h>
+#include <stdlib.h>
 #endif
+#include <math.h>
+#include <string.h>
+#include <atomic>
 
 const static int libMTSVersion = 0x00010003;
 
@@ -33,6 +37,584 @@ typedef void (*mts_void__pConstDouble_schar)(const double*, signed char);
 typedef void (*mts_void__double_char_schar)(double, char, signed char);
 typedef void (*mts_void__schar)(signed char);
 typedef void (*mts_void__double)(double);
+typedef void (*mts_void__bool)(bool);
+typedef int (*mts_int__pInt_pUInt_int_int)(int*, unsigned int*, int, int);
+typedef void (*mts_void__double_char_schar_double)(double, char, signed char, double);
+typedef void (*mts_void__int)(int);
+typedef bool (*mts_bool__int)(int);
+typedef void (*mts_void__int_pConstDouble)(int, const double*);
+typedef void (*mts_void__int_double_char)(int, double, char);
+typedef void (*mts_void__int_pConstChar)(int, const char*);
+typedef void (*mts_void__int_double)(int, double);
+typedef void (*mts_void__int_schar)(int, signed char);
+typedef void (*mts_void__int_bool_char_schar)(int, bool, char, signed char);
+typedef void (*mts_void__int_bool_schar)(int, bool, signed char);
+typedef void (*mts_void__int_pConstDouble_schar)(int, const double*, signed char);
+typedef void (*mts_void__int_double_char_schar)(int, double, char, signed char);
+typedef void (*mts_void__int_double_char_schar_double)(int, double, char, signed char, double);
+
+// Changes made between MTS_BeginUpdate() and MTS_CommitUpdate(), held here until they are published together.
+// Tunings are mirrored so that a changed table can be sent with a single call however many notes were changed.
+struct mtsmasterupdate
+{
+    enum {eFilterNote = 0, eFilterNoteMultiChannel, eClearNoteFilter, eClearNoteFilterMultiChannel};
+    
+    struct FilterOp
+    {
+        unsigned char type;
+        char midinote;
+        signed char midichannel;
+        bool doFilter;
+    };
+    
+    enum {eMaxFilterOps = 2 * 17 * 128 + 17}; // one per note and channel for each type, plus one of each clear
+    
+    mtsmasterupdate()
+    : depth(0)
+    {
+        reset();
+    }
+    
+    void reset()
+    {
+        for (int i = 0; i < 128; i++)
+        {
+            freqs[i] = 440.0 * pow(2.0, (i - 69.0) / 12.0);
+            for (int j = 0; j < 16; j++)
+                multiChannelFreqs[j][i] = freqs[i];
+        }
+        for (int i = 0; i < 16; i++)
+            multiChannelSet[i] = false;
+        scaleName[0] = '\0';
+        periodRatio = 2.0;
+        mapSize = -1;
+        mapStartKey = -1;
+        refKey = -1;
+        clearChanges();
+    }
+    
+    void clearChanges()
+    {
+        freqsChanged = false;
+        multiChannelFreqsChanged = 0;
+        multiChannelSetChanged = 0;
+        scaleNameChanged = false;
+        periodRatioChanged = false;
+        mapSizeChanged = false;
+        mapStartKeyChanged = false;
+        refKeyChanged = false;
+        clearFilterOps(eFilterNote);
+        clearFilterOps(eFilterNoteMultiChannel);
+        numFilterOps = 0;
+    }
+    
+    // Queues a filter operation, replacing any queued operation for the same note and channel.
+    void addFilterOp(unsigned char type, char midinote, signed char midichannel, bool doFilter)
+    {
+        short *opIndex = 0;
+        if (type == eFilterNote || type == eFilterNoteMultiChannel)
+        {
+            opIndex = &filterOpIndex[type][(midichannel & ~15) ? 16 : midichannel][midinote & 127];
+            if (*opIndex >= 0)
+            {
+                filterOps[*opIndex].doFilter = doFilter;
+                return;
+            }
+        }
+        else
+        {
+            // Operations queued before a clear have no effect, apart from those on other channels
+            if (type == eClearNoteFilter)
+            {
+                clearFilterOps(eFilterNote);
+                removeFilterOps(eFilterNote, eClearNoteFilter, -1);
+            }
+            else
+            {
+                clearFilterOps(eFilterNoteMultiChannel);
+                removeFilterOps(eFilterNoteMultiChannel, eClearNoteFilterMultiChannel, midichannel);
+            }
+        }
+        
+        if (numFilterOps >= eMaxFilterOps)
+            return;
+        
+        if (opIndex)
+            *opIndex = static_cast<short>(numFilterOps);
+        
+        FilterOp &op = filterOps[numFilterOps++];
+        op.type = type;
+        op.midinote = midinote;
+        op.midichannel = midichannel;
+        op.doFilter = doFilter;
+    }
+    
+    // Removes queued filter and clear operations, for all channels if midichannel is -1, and re-indexes those that remain.
+    void removeFilterOps(unsigned char filterType, unsigned char clearType, signed char midichannel)
+    {
+        int n = 0;
+        for (int i = 0; i < numFilterOps; i++)
+        {
+            if ((filterOps[i].type == filterType || filterOps[i].type == clearType) &&
+                (midichannel < 0 || filterOps[i].midichannel == midichannel))
+            {
+                continue;
+            }
+            filterOps[n++] = filterOps[i];
+        }
+        numFilterOps = n;
+        
+        for (int i = 0; i < numFilterOps; i++)
+        {
+            FilterOp &op = filterOps[i];
+            if (op.type == eFilterNote || op.type == eFilterNoteMultiChannel)
+                filterOpIndex[op.type][(op.midichannel & ~15) ? 16 : op.midichannel][op.midinote & 127] = static_cast<short>(i);
+        }
+    }
+    
+    void clearFilterOps(unsigned char type)
+    {
+        for (int i = 0; i < 17; i++)
+            for (int j = 0; j < 128; j++)
+                filterOpIndex[type][i][j] = -1;
+    }
+    
+    int depth;
+    
+    double freqs[128];
+    double multiChannelFreqs[16][128];
+    bool multiChannelSet[16];
+    char scaleName[256];
+    double periodRatio;
+    signed char mapSize;
+    signed char mapStartKey;
+    signed char refKey;
+    
+    bool freqsChanged;
+    unsigned short multiChannelFreqsChanged;
+    unsigned short multiChannelSetChanged;
+    bool scaleNameChanged;
+    bool periodRatioChanged;
+    bool mapSizeChanged;
+    bool mapStartKeyChanged;
+    bool refKeyChanged;
+    
+    FilterOp filterOps[eMaxFilterOps];
+    short filterOpIndex[2][17][128];
+    int numFilterOps;
+};
+
+// Changes scheduled with MTS_ScheduleNoteTuning() that have not yet been applied to the tables, in time order.
+struct mtsmasterschedule
+{
+    struct Change
+    {
+        double time;
+        double freq;
+        char midinote;
+        signed char midichannel;
+    };
+    
+    enum {eSize = 1024};
+    
+    mtsmasterschedule() : head(0), tail(0), start(0) {}
+    
+    bool empty() const {return head == tail;}
+    bool full() const {return head - tail == eSize;}
+    void clear() {tail = start = head;}
+    
+    const Change &front() const {return changes[tail & (eSize - 1)];}
+    void pop() {tail++;}
+    
+    // Moves a change scheduled before the last, even if that has been applied, to the same time as the last, as libMTS does.
+    void push(double time, double freq, char midinote, signed char midichannel)
+    {
+        if (head != start && time < changes[(head - 1) & (eSize - 1)].time)
+            time = changes[(head - 1) & (eSize - 1)].time;
+        Change &c = changes[head++ & (eSize - 1)];
+        c.time = time;
+        c.freq = freq;
+        c.midinote = midinote;
+        c.midichannel = midichannel;
+    }
+    
+    Change changes[eSize];
+    unsigned int head;
+    unsigned int tail;
+    unsigned int start; // position of the first change since the schedule was last cleared
+};
+
+// Writes MIDI Tuning Standard SysEx messages into caller-supplied buffers. Every function returns the number of bytes
+// written, or 0 if the buffer is too small, and never allocates, so may be used on the audio thread.
+struct mtssysexencoder
+{
+    enum {eDeviceID = 0x7F, eMaxNotesPerMessage = 127, eNoteWordSize = 4};
+    
+    // Encodes a frequency as a note number and 14-bit fraction of a semitone above it, clamped to the MIDI note range.
+    // 7F 7F 7F is never produced, as it means no change. Zero, negative and NaN frequencies give the lowest value, and
+    // infinite frequencies or those above the range the highest, before anything is converted to an integer.
+    static void encodeFreq(double freq, unsigned char *word)
+    {
+        double semitones = 69.0 + 12.0 * log2(freq / 440.0);
+        int note = 0;
+        int fraction = 0;
+        if (semitones >= 128.0)
+        {
+            note = 127;
+            fraction = 16382;
+        }
+        else if (semitones > 0.0)
+        {
+            note = static_cast<int>(floor(semitones));
+            fraction = static_cast<int>(lround((semitones - note) * 16384.0));
+            if (fraction >= 16384)
+            {
+                note++;
+                fraction -= 16384;
+            }
+            if (note > 127 || (note == 127 && fraction > 16382))
+            {
+                note = 127;
+                fraction = 16382;
+            }
+        }
+        word[0] = static_cast<unsigned char>(note);
+        word[1] = static_cast<unsigned char>(fraction >> 7);
+        word[2] = static_cast<unsigned char>(fraction & 127);
+    }
+    
+    static inline bool sameWord(const unsigned char *a, const unsigned char *b) {return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];}
+    
+    static int bulkDump(unsigned char *buffer, int size, const double *freqs, const char *name, signed char bank, char program)
+    {
+        int messageSize = bank < 0 ? 408 : 409;
+        if (!buffer || !freqs || size < messageSize)
+            return 0;
+        
+        int n = 0;
+        buffer[n++] = 0xF0;
+        buffer[n++] = 0x7E;
+        buffer[n++] = eDeviceID;
+        buffer[n++] = 0x08;
+        buffer[n++] = bank < 0 ? 0x01 : 0x04;
+        if (bank >= 0)
+            buffer[n++] = static_cast<unsigned char>(bank & 127);
+        buffer[n++] = static_cast<unsigned char>(program & 127);
+        
+        bool nameEnded = !name;
+        for (int i = 0; i < 16; i++)
+        {
+            nameEnded = nameEnded || name[i] == '\0';
+            buffer[n++] = nameEnded ? ' ' : static_cast<unsigned char>(name[i] & 127);
+        }
+        
+        for (int i = 0; i < 128; i++, n += 3)
+            encodeFreq(freqs[i], buffer + n);
+        
+        unsigned char checksum = 0;
+        for (int i = 1; i < n; i++)
+            checksum ^= buffer[i];
+        buffer[n++] = checksum & 127;
+        buffer[n++] = 0xF7;
+        return n;
+    }
+    
+    // Writes single note tuning changes for notes[0, numNotes), packing up to 127 notes into each message, and stops at
+    // the last note that fits. numWritten receives the number of notes written. Without a bank, the realtime format
+    // without a bank number is used.
+    static int noteTunings(unsigned char *buffer, int size, const char *midinotes, const unsigned char (*words)[3], int numNotes, signed char bank, char program, bool realtime, int &numWritten)
+    {
+        int headerSize = bank < 0 ? 7 : 8;
+        int n = 0;
+        numWritten = 0;
+        while (numWritten < numNotes && size - n >= headerSize + eNoteWordSize + 1)
+        {
+            int count = numNotes - numWritten;
+            if (count > eMaxNotesPerMessage)
+                count = eMaxNotesPerMessage;
+            if (count > (size - n - headerSize - 1) / eNoteWordSize)
+                count = (size - n - headerSize - 1) / eNoteWordSize;
+            
+            buffer[n++] = 0xF0;
+            buffer[n++] = (realtime || bank < 0) ? 0x7F : 0x7E;
+            buffer[n++] = eDeviceID;
+            buffer[n++] = 0x08;
+            buffer[n++] = bank < 0 ? 0x02 : 0x07;
+            if (bank >= 0)
+                buffer[n++] = static_cast<unsigned char>(bank & 127);
+            buffer[n++] = static_cast<unsigned char>(program & 127);
+            buffer[n++] = static_cast<unsigned char>(count);
+            for (int i = 0; i < count; i++, numWritten++)
+            {
+                buffer[n++] = static_cast<unsigned char>(midinotes[numWritten] & 127);
+                buffer[n++] = words[numWritten][0];
+                buffer[n++] = words[numWritten][1];
+                buffer[n++] = words[numWritten][2];
+            }
+            buffer[n++] = 0xF7;
+        }
+        return n;
+    }
+    
+    // Detune of each pitch class in cents, as one byte (-64 to +63 cents) or two bytes (-100 to +100 cents), sent to the
+    // MIDI channels set in channelMask.
+    static int scaleOctave(unsigned char *buffer, int size, const double *cents, bool twoByte, unsigned short channelMask, bool realtime)
+    {
+        int messageSize = twoByte ? 33 : 21;
+        if (!buffer || !cents || size < messageSize)
+            return 0;
+        
+        int n = 0;
+        buffer[n++] = 0xF0;
+        buffer[n++] = realtime ? 0x7F : 0x7E;
+        buffer[n++] = eDeviceID;
+        buffer[n++] = 0x08;
+        buffer[n++] = twoByte ? 0x09 : 0x08;
+        buffer[n++] = static_cast<unsigned char>((channelMask >> 14) & 3);
+        buffer[n++] = static_cast<unsigned char>((channelMask >> 7) & 127);
+        buffer[n++] = static_cast<unsigned char>(channelMask & 127);
+        
+        for (int i = 0; i < 12; i++)
+        {
+            double c = cents[i] == cents[i] ? cents[i] : 0.0;
+            c = c < -200.0 ? -200.0 : (c > 200.0 ? 200.0 : c); // beyond either format, and keeps infinities out of lround()
+            if (twoByte)
+            {
+                double semitones = c * 0.01;
+                long value = 8192 + lround(semitones * (semitones > 0.0 ? 8191.0 : 8192.0));
+                value = value < 0 ? 0 : (value > 16383 ? 16383 : value);
+                buffer[n++] = static_cast<unsigned char>(value >> 7);
+                buffer[n++] = static_cast<unsigned char>(value & 127);
+            }
+            else
+            {
+                long value = 64 + lround(c);
+                buffer[n++] = static_cast<unsigned char>(value < 0 ? 0 : (value > 127 ? 127 : value));
+            }
+        }
+        
+        buffer[n++] = 0xF7;
+        return n;
+    }
+};
+
+// Opens libMTS the first time a client or master needs it, rather than whilst the host is loading or scanning the plugin, and
+// keeps it open until the plugin is unloaded. Defined identically in libMTSClient.cpp and libMTSMaster.cpp and with only inline
+// members, so a binary built with both shares one instance and opens libMTS once. The two definitions must be kept in step.
+// The MTS_ESP_LIBRARY_PATH environment variable names a library to try before the installed one, and a lookup function set
+// before first use replaces libMTS altogether, e.g. with stubs for testing.
+struct mtslibrary
+{
+    typedef void *(*symbollookup)(const char *name);
+    
+    static const mtslibrary &get()
+    {
+        static const mtslibrary library(pendingLookup()); // opened by whichever thread gets here first, others wait for it
+        return library;
+    }
+    
+    // Must be called before any client registers or master function is called, fails once libMTS has been opened.
+    static bool setLookup(symbollookup lookup)
+    {
+        if (opened())
+            return false;
+        pendingLookup() = lookup;
+        return true;
+    }
+    
+    bool isOpen() const {return lookup || handle;}
+    
+#ifdef MTS_ESP_WIN
+    void *symbol(const char *name) const
+    {
+        if (lookup)
+            return lookup(name);
+        return handle ? reinterpret_cast<void*>(GetProcAddress(handle, name)) : 0;
+    }
+    
+private:
+    explicit mtslibrary(symbollookup symbolLookup) : handle(0), lookup(symbolLookup)
+    {
+        opened() = true;
+        if (lookup)
+            return;
+        
+        WCHAR path[MAX_PATH];
+        DWORD pathLen = GetEnvironmentVariableW(L"MTS_ESP_LIBRARY_PATH", path, MAX_PATH);
+        if (pathLen > 0 && pathLen < MAX_PATH && (handle = LoadLibraryW(path)))
+            return;
+        
+        SHGetKnownFolderPathFunc SHGetKnownFolderPath = 0;
+        CoTaskMemFreeFunc CoTaskMemFree = 0;
+        
+        HMODULE shell32Module = GetModuleHandleW(L"Shell32.dll");
+        HMODULE ole32Module = GetModuleHandleW(L"Ole32.dll");
+        
+        if (shell32Module)
+            SHGetKnownFolderPath = (SHGetKnownFolderPathFunc)GetProcAddress(shell32Module, "SHGetKnownFolderPath");
+        
+        if (ole32Module)
+            CoTaskMemFree = (CoTaskMemFreeFunc)GetProcAddress(ole32Module, "CoTaskMemFree");
+        
+        if (!SHGetKnownFolderPath || !CoTaskMemFree)
+            return;
+        
+        const GUID FOLDERID_ProgramFilesCommonGUID = {0xF7F1ED05, 0x9F6D, 0x47A2, 0xAA, 0xAE, 0x29, 0xD3, 0x17, 0xC6, 0xF0, 0x66};
+        PWSTR cf = NULL;
+        if (SHGetKnownFolderPath(&FOLDERID_ProgramFilesCommonGUID, 0, 0, &cf) >= 0)
+        {
+            WCHAR buffer[MAX_PATH];
+            buffer[0] = L'\0';
+            if (cf)
+                wcsncpy(buffer, cf, MAX_PATH);
+            CoTaskMemFree(cf);
+            buffer[MAX_PATH - 1] = L'\0';
+            const WCHAR *libpath = L"\\MTS-ESP\\LIBMTS.dll";
+            DWORD cfLen = wcslen(buffer);
+            wcsncat(buffer, libpath, MAX_PATH - cfLen - 1);
+            handle = LoadLibraryW(buffer);
+        }
+        else
+        {
+            CoTaskMemFree(cf);
+        }
+    }
+    
+    ~mtslibrary()
+    {
+        if (handle)
+            FreeLibrary(handle);
+    }
+    
+    HINSTANCE handle;
+#else
+    void *symbol(const char *name) const
+    {
+        if (lookup)
+            return lookup(name);
+        return handle ? dlsym(handle, name) : 0;
+    }
+    
+private:
+    explicit mtslibrary(symbollookup symbolLookup) : handle(0), lookup(symbolLookup)
+    {
+        opened() = true;
+        if (lookup)
+            return;
+        
+        const char *path = getenv("MTS_ESP_LIBRARY_PATH");
+        if (path && *path && (handle = dlopen(path, RTLD_NOW)))
+            return;
+        
+        if (!(handle = dlopen("/Library/Application Support/MTS-ESP/libMTS.dylib", RTLD_NOW)))
+            handle = dlopen("/usr/local/lib/libMTS.so", RTLD_NOW);
+    }
+    
+    ~mtslibrary()
+    {
+        if (handle)
+            dlclose(handle);
+    }
+    
+    void *handle;
+#endif
+    
+    static symbollookup &pendingLookup() {static symbollookup pending = 0; return pending;}
+    static bool &opened() {static bool value = false; return value;}
+    
+    symbollookup lookup;
+    
+    mtslibrary(const mtslibrary&);
+    mtslibrary &operator=(const mtslibrary&);
+};
+
+// The master's state for one tuning slot in libMTS. Slot 0 is the one used by the functions without a slot argument.
+struct mtsmasterslot
+{
+    explicit mtsmasterslot(int slotIndex) : index(slotIndex) {}
+    
+    inline bool isUpdating() const {return update.depth > 0;}
+    
+    // Calls into libMTS for this slot. Slot 0 uses the original functions, so that it works with older versions of libMTS.
+    inline void registerMaster() const;
+    inline void deregisterMaster() const;
+    inline bool hasMaster() const;
+    inline void beginUpdate() const;
+    inline void commitUpdate() const;
+    inline void setNoteTunings(const double *freqs) const;
+    inline void setNoteTuning(double freq, char midinote) const;
+    inline void setScaleName(const char *name) const;
+    inline void setPeriodRatio(double periodRatio) const;
+    inline void setMapSize(signed char size) const;
+    inline void setMapStartKey(signed char key) const;
+    inline void setRefKey(signed char key) const;
+    inline void filterNote(bool doFilter, char midinote, signed char midichannel) const;
+    inline void clearNoteFilter() const;
+    inline void setMultiChannel(bool set, signed char midichannel) const;
+    inline void setMultiChannelNoteTunings(const double *freqs, signed char midichannel) const;
+    inline void setMultiChannelNoteTuning(double freq, char midinote, signed char midichannel) const;
+    inline void filterNoteMultiChannel(bool doFilter, char midinote, signed char midichannel) const;
+    inline void clearNoteFilterMultiChannel(signed char midichannel) const;
+    inline void scheduleNoteTuning(double freq, char midinote, signed char midichannel, double sampleTime) const;
+    inline void clearScheduledTunings() const;
+    
+    // Sends everything changed since MTS_BeginUpdate() to libMTS, inside a libMTS update if supported so that clients
+    // see the changes all at once.
+    void sendUpdate()
+    {
+        beginUpdate();
+        
+        if (update.freqsChanged)
+            setNoteTunings(update.freqs);
+        
+        for (int i = 0; i < 16; i++)
+            if ((update.multiChannelSetChanged >> i) & 1)
+                setMultiChannel(update.multiChannelSet[i], static_cast<signed char>(i));
+        
+        for (int i = 0; i < 16; i++)
+            if ((update.multiChannelFreqsChanged >> i) & 1)
+                setMultiChannelNoteTunings(update.multiChannelFreqs[i], static_cast<signed char>(i));
+        
+        for (int i = 0; i < update.numFilterOps; i++)
+        {
+            const mtsmasterupdate::FilterOp &op = update.filterOps[i];
+            switch (op.type)
+            {
+                case mtsmasterupdate::eFilterNote:
+                    filterNote(op.doFilter, op.midinote, op.midichannel);
+                    break;
+                case mtsmasterupdate::eFilterNoteMultiChannel:
+                    filterNoteMultiChannel(op.doFilter, op.midinote, op.midichannel);
+                    break;
+                case mtsmasterupdate::eClearNoteFilter:
+                    clearNoteFilter();
+                    break;
+                case mtsmasterupdate::eClearNoteFilterMultiChannel:
+                    clearNoteFilterMultiChannel(op.midichannel);
+                    break;
+            }
+        }
+        
+        if (update.scaleNameChanged)
+            setScaleName(update.scaleName);
+        if (update.periodRatioChanged)
+            setPeriodRatio(update.periodRatio);
+        if (update.mapSizeChanged)
+            setMapSize(update.mapSize);
+        if (update.mapStartKeyChanged)
+            setMapStartKey(update.mapStartKey);
+        if (update.refKeyChanged)
+            setRefKey(update.refKey);
+        
+        commitUpdate();
+        
+        update.clearChanges();
+    }
+    
+    int index;
+    mtsmasterupdate update;
+    mtsmasterschedule schedule;
+};
 
 struct mtsmasterglobal
 {
@@ -58,9 +640,44 @@ struct mtsmasterglobal
     , SetMultiChannelNoteTuning(0)
     , FilterNoteMultiChannel(0)
     , ClearNoteFilterMultiChannel(0)
-    , handle(0)
+    , BeginUpdate(0)
+    , CommitUpdate(0)
+    , SetDiagnosticsEnabled(0)
+    , GetDiagnostics(0)
+    , ScheduleNoteTuning(0)
+    , ClearScheduledTunings(0)
+    , SlotRegisterMaster(0)
+    , SlotDeregisterMaster(0)
+    , SlotHasMaster(0)
+    , SlotSetNoteTunings(0)
+    , SlotSetNoteTuning(0)
+    , SlotSetScaleName(0)
+    , SlotSetPeriodRatio(0)
+    , SlotSetMapSize(0)
+    , SlotSetMapStartKey(0)
+    , SlotSetRefKey(0)
+    , SlotFilterNote(0)
+    , SlotClearNoteFilter(0)
+    , SlotSetMultiChannel(0)
+    , SlotSetMultiChannelNoteTunings(0)
+    , SlotSetMultiChannelNoteTuning(0)
+    , SlotFilterNoteMultiChannel(0)
+    , SlotClearNoteFilterMultiChannel(0)
+    , SlotBeginUpdate(0)
+    , SlotCommitUpdate(0)
+    , SlotScheduleNoteTuning(0)
+    , SlotClearScheduledTunings(0)
+    , defaultSlot(0)
     {
-        load_lib();
+        slots[0] = &defaultSlot;
+        for (int i = 1; i < eNumSlots; i++)
+            slots[i] = 0;
+    }
+    
+    ~mtsmasterglobal()
+    {
+        for (int i = 1; i < eNumSlots; i++)
+            delete slots[i].load();
     }
     
     mts_void__pVoid RegisterMaster;
@@ -84,144 +701,597 @@ struct mtsmasterglobal
     mts_void__double_char_schar SetMultiChannelNoteTuning;
     mts_void__bool_char_schar FilterNoteMultiChannel;
     mts_void__schar ClearNoteFilterMultiChannel;
+    mts_void__void BeginUpdate;
+    mts_void__void CommitUpdate;
+    mts_void__bool SetDiagnosticsEnabled;
+    mts_int__pInt_pUInt_int_int GetDiagnostics;
+    mts_void__double_char_schar_double ScheduleNoteTuning;
+    mts_void__void ClearScheduledTunings;
+    mts_void__int SlotRegisterMaster;
+    mts_void__int SlotDeregisterMaster;
+    mts_bool__int SlotHasMaster;
+    mts_void__int_pConstDouble SlotSetNoteTunings;
+    mts_void__int_double_char SlotSetNoteTuning;
+    mts_void__int_pConstChar SlotSetScaleName;
+    mts_void__int_double SlotSetPeriodRatio;
+    mts_void__int_schar SlotSetMapSize;
+    mts_void__int_schar SlotSetMapStartKey;
+    mts_void__int_schar SlotSetRefKey;
+    mts_void__int_bool_char_schar SlotFilterNote;
+    mts_void__int SlotClearNoteFilter;
+    mts_void__int_bool_schar SlotSetMultiChannel;
+    mts_void__int_pConstDouble_schar SlotSetMultiChannelNoteTunings;
+    mts_void__int_double_char_schar SlotSetMultiChannelNoteTuning;
+    mts_void__int_bool_char_schar SlotFilterNoteMultiChannel;
+    mts_void__int_schar SlotClearNoteFilterMultiChannel;
+    mts_void__int SlotBeginUpdate;
+    mts_void__int SlotCommitUpdate;
+    mts_void__int_double_char_schar_double SlotScheduleNoteTuning;
+    mts_void__int SlotClearScheduledTunings;
     
-#ifdef MTS_ESP_WIN
-    void load_lib()
+    // Other slots are allocated when first used and never freed before exit.
+    enum {eNumSlots = 16};
+    
+    mtsmasterslot defaultSlot;
+    std::atomic<mtsmasterslot*> slots[eNumSlots];
+    
+    mtsmasterslot *slot(int index);
+    
+    // Resolves the master functions on first use, so libMTS is not opened until the plugin actually acts as a master.
+    void load()
     {
-        SHGetKnownFolderPathFunc SHGetKnownFolderPath = 0;
-        CoTaskMemFreeFunc CoTaskMemFree = 0;
-        
-        HMODULE shell32Module = GetModuleHandleW(L"Shell32.dll");
-        HMODULE ole32Module = GetModuleHandleW(L"Ole32.dll");
-        
-        if (shell32Module)
-            SHGetKnownFolderPath = (SHGetKnownFolderPathFunc)GetProcAddress(shell32Module, "SHGetKnownFolderPath");
-       
-        if (ole32Module)
-            CoTaskMemFree = (CoTaskMemFreeFunc)GetProcAddress(ole32Module, "CoTaskMemFree");
-        
-        if (SHGetKnownFolderPath && CoTaskMemFree)
-        {
-            const GUID FOLDERID_ProgramFilesCommonGUID = {0xF7F1ED05, 0x9F6D, 0x47A2, 0xAA, 0xAE, 0x29, 0xD3, 0x17, 0xC6, 0xF0, 0x66};
-            PWSTR cf = NULL;
-            if (SHGetKnownFolderPath(&FOLDERID_ProgramFilesCommonGUID, 0, 0, &cf) >= 0)
-            {
-                WCHAR buffer[MAX_PATH];
-                buffer[0] = L'\0';
-                if (cf)
-                    wcsncpy(buffer, cf, MAX_PATH);
-                CoTaskMemFree(cf);
-                buffer[MAX_PATH - 1] = L'\0';
-                const WCHAR *libpath = L"\\MTS-ESP\\LIBMTS.dll";
-                DWORD cfLen = wcslen(buffer);
-                wcsncat(buffer, libpath, MAX_PATH - cfLen - 1);
-                handle = LoadLibraryW(buffer);
-                if (!handle)
-                    return;
-            }
-            else 
-            {
-                CoTaskMemFree(cf);
-                return;
-            }
-        }
-        else 
-        {
-            return;
-        }
-        
-        RegisterMaster              = (mts_void__pVoid)                 GetProcAddress(handle, "MTS_RegisterMaster");
-        DeregisterMaster            = (mts_void__void)                  GetProcAddress(handle, "MTS_DeregisterMaster");
-        Reinitialize                = (mts_void__void)                  GetProcAddress(handle, "MTS_Reinitialize");
-        HasMaster                   = (mts_bool__void)                  GetProcAddress(handle, "MTS_HasMaster");
-        HasIPC                      = (mts_bool__void)                  GetProcAddress(handle, "MTS_HasIPC");
-        GetVersionNumber            = (mts_int__void)                   GetProcAddress(handle, "MTS_GetVersionNumber");
-        GetNumClients               = (mts_int__void)                   GetProcAddress(handle, "MTS_GetNumClients");
-        SetNoteTunings              = (mts_void__pConstDouble)          GetProcAddress(handle, "MTS_SetNoteTunings");
-        SetNoteTuning               = (mts_void__double_char)           GetProcAddress(handle, "MTS_SetNoteTuning");
-        SetScaleName                = (mts_void__pConstChar)            GetProcAddress(handle, "MTS_SetScaleName");
-        SetPeriodRatio              = (mts_void__double)                GetProcAddress(handle, "MTS_SetPeriodRatio");
-        SetMapSize                  = (mts_void__schar)                 GetProcAddress(handle, "MTS_SetMapSize");
-        SetMapStartKey              = (mts_void__schar)                 GetProcAddress(handle, "MTS_SetMapStartKey");
-        SetRefKey                   = (mts_void__schar)                 GetProcAddress(handle, "MTS_SetRefKey");
-        FilterNote                  = (mts_void__bool_char_schar)       GetProcAddress(handle, "MTS_FilterNote");
-        ClearNoteFilter             = (mts_void__void)                  GetProcAddress(handle, "MTS_ClearNoteFilter");
-        SetMultiChannel             = (mts_void__bool_schar)            GetProcAddress(handle, "MTS_SetMultiChannel");
-        SetMultiChannelNoteTunings  = (mts_void__pConstDouble_schar)    GetProcAddress(handle, "MTS_SetMultiChannelNoteTunings");
-        SetMultiChannelNoteTuning   = (mts_void__double_char_schar)     GetProcAddress(handle, "MTS_SetMultiChannelNoteTuning");
-        FilterNoteMultiChannel      = (mts_void__bool_char_schar)       GetProcAddress(handle, "MTS_FilterNoteMultiChannel");
-        ClearNoteFilterMultiChannel = (mts_void__schar)                 GetProcAddress(handle, "MTS_ClearNoteFilterMultiChannel");
+        static const bool loaded = load_lib();
+        (void)loaded;
     }
     
-    ~mtsmasterglobal()
+    bool load_lib()
     {
-        if (handle)
-            FreeLibrary(handle);
+        const mtslibrary &lib = mtslibrary::get();
+        if (!lib.isOpen())
+            return false;
+        
+        RegisterMaster              = (mts_void__pVoid)                 lib.symbol("MTS_RegisterMaster");
+        DeregisterMaster            = (mts_void__void)                  lib.symbol("MTS_DeregisterMaster");
+        Reinitialize                = (mts_void__void)                  lib.symbol("MTS_Reinitialize");
+        HasMaster                   = (mts_bool__void)                  lib.symbol("MTS_HasMaster");
+        HasIPC                      = (mts_bool__void)                  lib.symbol("MTS_HasIPC");
+        GetVersionNumber            = (mts_int__void)                   lib.symbol("MTS_GetVersionNumber");
+        GetNumClients               = (mts_int__void)                   lib.symbol("MTS_GetNumClients");
+        SetNoteTunings              = (mts_void__pConstDouble)          lib.symbol("MTS_SetNoteTunings");
+        SetNoteTuning               = (mts_void__double_char)           lib.symbol("MTS_SetNoteTuning");
+        SetScaleName                = (mts_void__pConstChar)            lib.symbol("MTS_SetScaleName");
+        SetPeriodRatio              = (mts_void__double)                lib.symbol("MTS_SetPeriodRatio");
+        SetMapSize                  = (mts_void__schar)                 lib.symbol("MTS_SetMapSize");
+        SetMapStartKey              = (mts_void__schar)                 lib.symbol("MTS_SetMapStartKey");
+        SetRefKey                   = (mts_void__schar)                 lib.symbol("MTS_SetRefKey");
+        FilterNote                  = (mts_void__bool_char_schar)       lib.symbol("MTS_FilterNote");
+        ClearNoteFilter             = (mts_void__void)                  lib.symbol("MTS_ClearNoteFilter");
+        SetMultiChannel             = (mts_void__bool_schar)            lib.symbol("MTS_SetMultiChannel");
+        SetMultiChannelNoteTunings  = (mts_void__pConstDouble_schar)    lib.symbol("MTS_SetMultiChannelNoteTunings");
+        SetMultiChannelNoteTuning   = (mts_void__double_char_schar)     lib.symbol("MTS_SetMultiChannelNoteTuning");
+        FilterNoteMultiChannel      = (mts_void__bool_char_schar)       lib.symbol("MTS_FilterNoteMultiChannel");
+        ClearNoteFilterMultiChannel = (mts_void__schar)                 lib.symbol("MTS_ClearNoteFilterMultiChannel");
+        BeginUpdate                 = (mts_void__void)                  lib.symbol("MTS_BeginUpdate");
+        CommitUpdate                = (mts_void__void)                  lib.symbol("MTS_CommitUpdate");
+        SetDiagnosticsEnabled       = (mts_void__bool)                  lib.symbol("MTS_SetDiagnosticsEnabled");
+        GetDiagnostics              = (mts_int__pInt_pUInt_int_int)     lib.symbol("MTS_GetDiagnostics");
+        ScheduleNoteTuning          = (mts_void__double_char_schar_double) lib.symbol("MTS_ScheduleNoteTuning");
+        ClearScheduledTunings       = (mts_void__void)                  lib.symbol("MTS_ClearScheduledTunings");
+        SlotRegisterMaster              = (mts_void__int) lib.symbol("MTS_Slot_RegisterMaster");
+        SlotDeregisterMaster            = (mts_void__int) lib.symbol("MTS_Slot_DeregisterMaster");
+        SlotHasMaster                   = (mts_bool__int) lib.symbol("MTS_Slot_HasMaster");
+        SlotSetNoteTunings              = (mts_void__int_pConstDouble) lib.symbol("MTS_Slot_SetNoteTunings");
+        SlotSetNoteTuning               = (mts_void__int_double_char) lib.symbol("MTS_Slot_SetNoteTuning");
+        SlotSetScaleName                = (mts_void__int_pConstChar) lib.symbol("MTS_Slot_SetScaleName");
+        SlotSetPeriodRatio              = (mts_void__int_double) lib.symbol("MTS_Slot_SetPeriodRatio");
+        SlotSetMapSize                  = (mts_void__int_schar) lib.symbol("MTS_Slot_SetMapSize");
+        SlotSetMapStartKey              = (mts_void__int_schar) lib.symbol("MTS_Slot_SetMapStartKey");
+        SlotSetRefKey                   = (mts_void__int_schar) lib.symbol("MTS_Slot_SetRefKey");
+        SlotFilterNote                  = (mts_void__int_bool_char_schar) lib.symbol("MTS_Slot_FilterNote");
+        SlotClearNoteFilter             = (mts_void__int) lib.symbol("MTS_Slot_ClearNoteFilter");
+        SlotSetMultiChannel             = (mts_void__int_bool_schar) lib.symbol("MTS_Slot_SetMultiChannel");
+        SlotSetMultiChannelNoteTunings  = (mts_void__int_pConstDouble_schar) lib.symbol("MTS_Slot_SetMultiChannelNoteTunings");
+        SlotSetMultiChannelNoteTuning   = (mts_void__int_double_char_schar) lib.symbol("MTS_Slot_SetMultiChannelNoteTuning");
+        SlotFilterNoteMultiChannel      = (mts_void__int_bool_char_schar) lib.symbol("MTS_Slot_FilterNoteMultiChannel");
+        SlotClearNoteFilterMultiChannel = (mts_void__int_schar) lib.symbol("MTS_Slot_ClearNoteFilterMultiChannel");
+        SlotBeginUpdate                 = (mts_void__int) lib.symbol("MTS_Slot_BeginUpdate");
+        SlotCommitUpdate                = (mts_void__int) lib.symbol("MTS_Slot_CommitUpdate");
+        SlotScheduleNoteTuning          = (mts_void__int_double_char_schar_double) lib.symbol("MTS_Slot_ScheduleNoteTuning");
+        SlotClearScheduledTunings       = (mts_void__int) lib.symbol("MTS_Slot_ClearScheduledTunings");
+        return true;
+    }
+};
+
+static mtsmasterglobal global;
+
+inline void mtsmasterslot::registerMaster() const                  {if (index) {if (global.SlotRegisterMaster) global.SlotRegisterMaster(index);} else if (global.RegisterMaster) global.RegisterMaster(0);}
+inline void mtsmasterslot::deregisterMaster() const                {if (index) {if (global.SlotDeregisterMaster) global.SlotDeregisterMaster(index);} else if (global.DeregisterMaster) global.DeregisterMaster();}
+inline bool mtsmasterslot::hasMaster() const                       {return index ? (global.SlotHasMaster && global.SlotHasMaster(index)) : (global.HasMaster && global.HasMaster());}
+inline void mtsmasterslot::beginUpdate() const                     {if (index) {if (global.SlotBeginUpdate) global.SlotBeginUpdate(index);} else if (global.BeginUpdate) global.BeginUpdate();}
+inline void mtsmasterslot::commitUpdate() const                    {if (index) {if (global.SlotCommitUpdate) global.SlotCommitUpdate(index);} else if (global.CommitUpdate) global.CommitUpdate();}
+inline void mtsmasterslot::setNoteTunings(const double *freqs) const {if (index) {if (global.SlotSetNoteTunings) global.SlotSetNoteTunings(index, freqs);} else if (global.SetNoteTunings) global.SetNoteTunings(freqs);}
+inline void mtsmasterslot::setNoteTuning(double freq, char midinote) const {if (index) {if (global.SlotSetNoteTuning) global.SlotSetNoteTuning(index, freq, midinote);} else if (global.SetNoteTuning) global.SetNoteTuning(freq, midinote);}
+inline void mtsmasterslot::setScaleName(const char *name) const    {if (index) {if (global.SlotSetScaleName) global.SlotSetScaleName(index, name);} else if (global.SetScaleName) global.SetScaleName(name);}
+inline void mtsmasterslot::setPeriodRatio(double periodRatio) const {if (index) {if (global.SlotSetPeriodRatio) global.SlotSetPeriodRatio(index, periodRatio);} else if (global.SetPeriodRatio) global.SetPeriodRatio(periodRatio);}
+inline void mtsmasterslot::setMapSize(signed char size) const      {if (index) {if (global.SlotSetMapSize) global.SlotSetMapSize(index, size);} else if (global.SetMapSize) global.SetMapSize(size);}
+inline void mtsmasterslot::setMapStartKey(signed char key) const   {if (index) {if (global.SlotSetMapStartKey) global.SlotSetMapStartKey(index, key);} else if (global.SetMapStartKey) global.SetMapStartKey(key);}
+inline void mtsmasterslot::setRefKey(signed char key) const        {if (index) {if (global.SlotSetRefKey) global.SlotSetRefKey(index, key);} else if (global.SetRefKey) global.SetRefKey(key);}
+inline void mtsmasterslot::clearNoteFilter() const                 {if (index) {if (global.SlotClearNoteFilter) global.SlotClearNoteFilter(index);} else if (global.ClearNoteFilter) global.ClearNoteFilter();}
+inline void mtsmasterslot::clearScheduledTunings() const           {if (index) {if (global.SlotClearScheduledTunings) global.SlotClearScheduledTunings(index);} else if (global.ClearScheduledTunings) global.ClearScheduledTunings();}
+
+inline void mtsmasterslot::filterNote(bool doFilter, char midinote, signed char midichannel) const
+{
+    if (index)
+    {
+        if (global.SlotFilterNote) global.SlotFilterNote(index, doFilter, midinote, midichannel);
+    }
+    else if (global.FilterNote) global.FilterNote(doFilter, midinote, midichannel);
+}
+
+inline void mtsmasterslot::setMultiChannel(bool set, signed char midichannel) const
+{
+    if (index)
+    {
+        if (global.SlotSetMultiChannel) global.SlotSetMultiChannel(index, set, midichannel);
+    }
+    else if (global.SetMultiChannel) global.SetMultiChannel(set, midichannel);
+}
+
+inline void mtsmasterslot::setMultiChannelNoteTunings(const double *freqs, signed char midichannel) const
+{
+    if (index)
+    {
+        if (global.SlotSetMultiChannelNoteTunings) global.SlotSetMultiChannelNoteTunings(index, freqs, midichannel);
+    }
+    else if (global.SetMultiChannelNoteTunings) global.SetMultiChannelNoteTunings(freqs, midichannel);
+}
+
+inline void mtsmasterslot::setMultiChannelNoteTuning(double freq, char midinote, signed char midichannel) const
+{
+    if (index)
+    {
+        if (global.SlotSetMultiChannelNoteTuning) global.SlotSetMultiChannelNoteTuning(index, freq, midinote, midichannel);
+    }
+    else if (global.SetMultiChannelNoteTuning) global.SetMultiChannelNoteTuning(freq, midinote, midichannel);
+}
+
+inline void mtsmasterslot::filterNoteMultiChannel(bool doFilter, char midinote, signed char midichannel) const
+{
+    if (index)
+    {
+        if (global.SlotFilterNoteMultiChannel) global.SlotFilterNoteMultiChannel(index, doFilter, midinote, midichannel);
+    }
+    else if (global.FilterNoteMultiChannel) global.FilterNoteMultiChannel(doFilter, midinote, midichannel);
+}
+
+inline void mtsmasterslot::clearNoteFilterMultiChannel(signed char midichannel) const
+{
+    if (index)
+    {
+        if (global.SlotClearNoteFilterMultiChannel) global.SlotClearNoteFilterMultiChannel(index, midichannel);
+    }
+    else if (global.ClearNoteFilterMultiChannel) global.ClearNoteFilterMultiChannel(midichannel);
+}
+
+inline void mtsmasterslot::scheduleNoteTuning(double freq, char midinote, signed char midichannel, double sampleTime) const
+{
+    if (index)
+    {
+        if (global.SlotScheduleNoteTuning) global.SlotScheduleNoteTuning(index, freq, midinote, midichannel, sampleTime);
     }
+    else if (global.ScheduleNoteTuning) global.ScheduleNoteTuning(freq, midinote, midichannel, sampleTime);
+}
+
+// Returns 0 for a slot that does not exist. Slots first used from several threads at once may each be allocated, in
+// which case all but one copy is discarded.
+mtsmasterslot *mtsmasterglobal::slot(int index)
+{
+    load();
+    if (index < 0 || index >= eNumSlots)
+        return 0;
     
-    HINSTANCE handle;
-#else
-    void load_lib()
+    mtsmasterslot *allocated = slots[index].load(std::memory_order_acquire);
+    if (allocated)
+        return allocated;
+    
+    mtsmasterslot *s = new mtsmasterslot(index);
+    if (!slots[index].compare_exchange_strong(allocated, s, std::memory_order_acq_rel))
     {
-        if (!(handle = dlopen("/Library/Application Support/MTS-ESP/libMTS.dylib", RTLD_NOW)) &&
-            !(handle = dlopen("/usr/local/lib/libMTS.so", RTLD_NOW)))
+        delete s;
+        return allocated;
+    }
+    return s;
+}
+
+void MTS_RegisterMaster()                                                               {MTS_Slot_RegisterMaster(0);}
+void MTS_DeregisterMaster()                                                             {MTS_Slot_DeregisterMaster(0);}
+bool MTS_CanRegisterMaster()                                                            {return MTS_Slot_CanRegisterMaster(0);}
+bool MTS_HasIPC()                                                                       {global.load(); return global.HasIPC ? global.HasIPC() : false;}
+bool MTS_Master_ShouldUpdateLibrary()                                                   {global.load(); return global.GetVersionNumber ? (global.GetVersionNumber() < libMTSVersion) : false;}
+bool MTS_Master_SetLibraryLookup(void *(*lookup)(const char *name))                     {return mtslibrary::setLookup(lookup);}
+int  MTS_GetNumClients()                                                                {global.load(); return global.GetNumClients ? global.GetNumClients() : 0;}
+void MTS_BeginUpdate()                                                                  {MTS_Slot_BeginUpdate(0);}
+void MTS_CommitUpdate()                                                                 {MTS_Slot_CommitUpdate(0);}
+void MTS_SetNoteTunings(const double *freqs)                                            {MTS_Slot_SetNoteTunings(0, freqs);}
+void MTS_SetNoteTuning(double freq, char midinote)                                      {MTS_Slot_SetNoteTuning(0, freq, midinote);}
+void MTS_SetScaleName(const char *name)                                                 {MTS_Slot_SetScaleName(0, name);}
+void MTS_SetPeriodRatio(double periodRatio)                                             {MTS_Slot_SetPeriodRatio(0, periodRatio);}
+void MTS_SetMapSize(signed char size)                                                   {MTS_Slot_SetMapSize(0, size);}
+void MTS_SetMapStartKey(signed char key)                                                {MTS_Slot_SetMapStartKey(0, key);}
+void MTS_SetRefKey(signed char key)                                                     {MTS_Slot_SetRefKey(0, key);}
+void MTS_FilterNote(bool doFilter, char midinote, signed char midichannel)              {MTS_Slot_FilterNote(0, doFilter, midinote, midichannel);}
+void MTS_ClearNoteFilter()                                                              {MTS_Slot_ClearNoteFilter(0);}
+void MTS_SetMultiChannel(bool set, signed char midichannel)                             {MTS_Slot_SetMultiChannel(0, set, midichannel);}
+void MTS_SetMultiChannelNoteTunings(const double *freqs, signed char midichannel)       {MTS_Slot_SetMultiChannelNoteTunings(0, freqs, midichannel);}
+void MTS_SetMultiChannelNoteTuning(double freq, char midinote, signed char midichannel) {MTS_Slot_SetMultiChannelNoteTuning(0, freq, midinote, midichannel);}
+void MTS_FilterNoteMultiChannel(bool doFilter, char midinote, signed char midichannel)  {MTS_Slot_FilterNoteMultiChannel(0, doFilter, midinote, midichannel);}
+void MTS_ClearNoteFilterMultiChannel(signed char midichannel)                           {MTS_Slot_ClearNoteFilterMultiChannel(0, midichannel);}
+void MTS_ScheduleNoteTuning(double freq, char midinote, signed char midichannel, double sampleTime) {MTS_Slot_ScheduleNoteTuning(0, freq, midinote, midichannel, sampleTime);}
+void MTS_ApplyScheduledTunings(double sampleTime)                                       {MTS_Slot_ApplyScheduledTunings(0, sampleTime);}
+void MTS_ClearScheduledTunings()                                                        {MTS_Slot_ClearScheduledTunings(0);}
+void MTS_EnableClientDiagnostics(bool enable)                                           {global.load(); if (global.SetDiagnosticsEnabled) global.SetDiagnosticsEnabled(enable);}
+
+// Resets every slot.
+void MTS_Reinitialize()
+{
+    global.load();
+    for (int i = 0; i < mtsmasterglobal::eNumSlots; i++)
+    {
+        if (mtsmasterslot *s = global.slots[i].load(std::memory_order_acquire))
         {
-            return;
+            s->update.depth = 0;
+            s->update.reset();
+            s->schedule.clear();
         }
+    }
+    if (global.Reinitialize) global.Reinitialize();
+}
+
+void MTS_Slot_RegisterMaster(int slot)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    s->update.reset();
+    s->schedule.clear();
+    s->registerMaster();
+}
+
+void MTS_Slot_DeregisterMaster(int slot)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    s->update.depth = 0;
+    s->update.clearChanges();
+    s->schedule.clear();
+    s->deregisterMaster();
+}
+
+bool MTS_Slot_CanRegisterMaster(int slot)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s || (slot && !global.SlotHasMaster)) // libMTS is too old to support slots
+        return false;
+    return !s->hasMaster();
+}
+
+void MTS_Slot_BeginUpdate(int slot)
+{
+    if (mtsmasterslot *s = global.slot(slot))
+        s->update.depth++;
+}
+
+void MTS_Slot_CommitUpdate(int slot)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (s && s->update.depth > 0 && --s->update.depth == 0)
+        s->sendUpdate();
+}
+
+void MTS_Slot_SetNoteTunings(int slot, const double *freqs)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    if (freqs)
+        memcpy(s->update.freqs, freqs, sizeof(s->update.freqs));
+    if (!s->isUpdating())
+    {
+        s->setNoteTunings(freqs);
+        return;
+    }
+    s->update.freqsChanged = true;
+}
+
+void MTS_Slot_SetNoteTuning(int slot, double freq, char midinote)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    s->update.freqs[midinote & 127] = freq;
+    if (!s->isUpdating())
+    {
+        s->setNoteTuning(freq, midinote);
+        return;
+    }
+    s->update.freqsChanged = true;
+}
+
+void MTS_Slot_SetScaleName(int slot, const char *name)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    if (!s->isUpdating())
+    {
+        s->setScaleName(name);
+        return;
+    }
+    strncpy(s->update.scaleName, name ? name : "", sizeof(s->update.scaleName) - 1);
+    s->update.scaleName[sizeof(s->update.scaleName) - 1] = '\0';
+    s->update.scaleNameChanged = true;
+}
+
+void MTS_Slot_SetPeriodRatio(int slot, double periodRatio)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    if (!s->isUpdating())
+    {
+        s->setPeriodRatio(periodRatio);
+        return;
+    }
+    s->update.periodRatio = periodRatio;
+    s->update.periodRatioChanged = true;
+}
+
+void MTS_Slot_SetMapSize(int slot, signed char size)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    if (!s->isUpdating())
+    {
+        s->setMapSize(size);
+        return;
+    }
+    s->update.mapSize = size;
+    s->update.mapSizeChanged = true;
+}
+
+void MTS_Slot_SetMapStartKey(int slot, signed char key)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    if (!s->isUpdating())
+    {
+        s->setMapStartKey(key);
+        return;
+    }
+    s->update.mapStartKey = key;
+    s->update.mapStartKeyChanged = true;
+}
+
+void MTS_Slot_SetRefKey(int slot, signed char key)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    if (!s->isUpdating())
+    {
+        s->setRefKey(key);
+        return;
+    }
+    s->update.refKey = key;
+    s->update.refKeyChanged = true;
+}
+
+void MTS_Slot_FilterNote(int slot, bool doFilter, char midinote, signed char midichannel)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    if (!s->isUpdating())
+    {
+        s->filterNote(doFilter, midinote, midichannel);
+        return;
+    }
+    s->update.addFilterOp(mtsmasterupdate::eFilterNote, midinote, midichannel, doFilter);
+}
+
+void MTS_Slot_ClearNoteFilter(int slot)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    if (!s->isUpdating())
+    {
+        s->clearNoteFilter();
+        return;
+    }
+    s->update.addFilterOp(mtsmasterupdate::eClearNoteFilter, 0, -1, false);
+}
+
+void MTS_Slot_SetMultiChannel(int slot, bool set, signed char midichannel)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    if (!s->isUpdating() || (midichannel & ~15))
+    {
+        s->setMultiChannel(set, midichannel);
+        return;
+    }
+    s->update.multiChannelSet[midichannel] = set;
+    s->update.multiChannelSetChanged |= 1 << midichannel;
+}
+
+void MTS_Slot_SetMultiChannelNoteTunings(int slot, const double *freqs, signed char midichannel)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    if (freqs && !(midichannel & ~15))
+        memcpy(s->update.multiChannelFreqs[midichannel], freqs, sizeof(s->update.multiChannelFreqs[midichannel]));
+    if (!s->isUpdating() || (midichannel & ~15))
+    {
+        s->setMultiChannelNoteTunings(freqs, midichannel);
+        return;
+    }
+    s->update.multiChannelFreqsChanged |= 1 << midichannel;
+}
+
+void MTS_Slot_SetMultiChannelNoteTuning(int slot, double freq, char midinote, signed char midichannel)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    if (!(midichannel & ~15))
+        s->update.multiChannelFreqs[midichannel][midinote & 127] = freq;
+    if (!s->isUpdating() || (midichannel & ~15))
+    {
+        s->setMultiChannelNoteTuning(freq, midinote, midichannel);
+        return;
+    }
+    s->update.multiChannelFreqsChanged |= 1 << midichannel;
+}
+
+void MTS_Slot_FilterNoteMultiChannel(int slot, bool doFilter, char midinote, signed char midichannel)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    if (!s->isUpdating() || (midichannel & ~15))
+    {
+        s->filterNoteMultiChannel(doFilter, midinote, midichannel);
+        return;
+    }
+    s->update.addFilterOp(mtsmasterupdate::eFilterNoteMultiChannel, midinote, midichannel, doFilter);
+}
+
+void MTS_Slot_ClearNoteFilterMultiChannel(int slot, signed char midichannel)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    if (!s->isUpdating() || (midichannel & ~15))
+    {
+        s->clearNoteFilterMultiChannel(midichannel);
+        return;
+    }
+    s->update.addFilterOp(mtsmasterupdate::eClearNoteFilterMultiChannel, 0, midichannel, false);
+}
+
+static void applyScheduledChange(int slot, const mtsmasterschedule::Change &c)
+{
+    if (c.midichannel & ~15)
+        MTS_Slot_SetNoteTuning(slot, c.freq, c.midinote);
+    else
+        MTS_Slot_SetMultiChannelNoteTuning(slot, c.freq, c.midinote, c.midichannel);
+}
+
+void MTS_Slot_ScheduleNoteTuning(int slot, double freq, char midinote, signed char midichannel, double sampleTime)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    if (s->schedule.full())
+    {
+        applyScheduledChange(slot, s->schedule.front());
+        s->schedule.pop();
+    }
+    if (midichannel & ~15)
+        midichannel = -1;
+    s->schedule.push(sampleTime, freq, midinote, midichannel);
+    s->scheduleNoteTuning(freq, midinote, midichannel, sampleTime);
+}
+
+void MTS_Slot_ApplyScheduledTunings(int slot, double sampleTime)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s || s->schedule.empty() || !(s->schedule.front().time < sampleTime))
+        return;
+    MTS_Slot_BeginUpdate(slot);
+    while (!s->schedule.empty() && s->schedule.front().time < sampleTime)
+    {
+        applyScheduledChange(slot, s->schedule.front());
+        s->schedule.pop();
+    }
+    MTS_Slot_CommitUpdate(slot);
+}
+
+void MTS_Slot_ClearScheduledTunings(int slot)
+{
+    mtsmasterslot *s = global.slot(slot);
+    if (!s)
+        return;
+    s->schedule.clear();
+    s->clearScheduledTunings();
+}
+
+int MTS_GetClientDiagnostics(int *processIDs, unsigned int *counters, int maxClients)
+{
+    global.load();
+    if (!global.GetDiagnostics || maxClients <= 0)
+        return 0;
+    return global.GetDiagnostics(processIDs, counters, MTS_NumDiagnosticCounters, maxClients);
+}
+
+int MTS_EncodeBulkDump(unsigned char *buffer, int size, const double *freqs, const char *name, signed char bank, char program)
+{
+    return mtssysexencoder::bulkDump(buffer, size, freqs, name, bank, program);
+}
+
+int MTS_EncodeNoteTunings(unsigned char *buffer, int size, const char *midinotes, const double *freqs, int numNotes, signed char bank, char program, bool realtime)
+{
+    if (!buffer || !midinotes || !freqs || numNotes <= 0)
+        return 0;
+    
+    int n = 0;
+    for (int i = 0; i < numNotes; i += 128)
+    {
+        unsigned char words[128][3];
+        int count = numNotes - i < 128 ? numNotes - i : 128;
+        for (int j = 0; j < count; j++)
+            mtssysexencoder::encodeFreq(freqs[i + j], words[j]);
         
-        RegisterMaster              = (mts_void__pVoid)                 dlsym(handle, "MTS_RegisterMaster");
-        DeregisterMaster            = (mts_void__void)                  dlsym(handle, "MTS_DeregisterMaster");
-        Reinitialize                = (mts_void__void)                  dlsym(handle, "MTS_Reinitialize");
-        HasMaster                   = (mts_bool__void)                  dlsym(handle, "MTS_HasMaster");
-        HasIPC                      = (mts_bool__void)                  dlsym(handle, "MTS_HasIPC");
-        GetVersionNumber            = (mts_int__void)                   dlsym(handle, "MTS_GetVersionNumber");
-        GetNumClients               = (mts_int__void)                   dlsym(handle, "MTS_GetNumClients");
-        SetNoteTunings              = (mts_void__pConstDouble)          dlsym(handle, "MTS_SetNoteTunings");
-        SetNoteTuning               = (mts_void__double_char)           dlsym(handle, "MTS_SetNoteTuning");
-        SetScaleName                = (mts_void__pConstChar)            dlsym(handle, "MTS_SetScaleName");
-        SetPeriodRatio              = (mts_void__double)                dlsym(handle, "MTS_SetPeriodRatio");
-        SetMapSize                  = (mts_void__schar)                 dlsym(handle, "MTS_SetMapSize");
-        SetMapStartKey              = (mts_void__schar)                 dlsym(handle, "MTS_SetMapStartKey");
-        SetRefKey                   = (mts_void__schar)                 dlsym(handle, "MTS_SetRefKey");
-        FilterNote                  = (mts_void__bool_char_schar)       dlsym(handle, "MTS_FilterNote");
-        ClearNoteFilter             = (mts_void__void)                  dlsym(handle, "MTS_ClearNoteFilter");
-        SetMultiChannel             = (mts_void__bool_schar)            dlsym(handle, "MTS_SetMultiChannel");
-        SetMultiChannelNoteTunings  = (mts_void__pConstDouble_schar)    dlsym(handle, "MTS_SetMultiChannelNoteTunings");
-        SetMultiChannelNoteTuning   = (mts_void__double_char_schar)     dlsym(handle, "MTS_SetMultiChannelNoteTuning");
-        FilterNoteMultiChannel      = (mts_void__bool_char_schar)       dlsym(handle, "MTS_FilterNoteMultiChannel");
-        ClearNoteFilterMultiChannel = (mts_void__schar)                 dlsym(handle, "MTS_ClearNoteFilterMultiChannel");
+        int numWritten = 0;
+        n += mtssysexencoder::noteTunings(buffer + n, size - n, midinotes + i, words, count, bank, program, realtime, numWritten);
+        if (numWritten < count)
+            return 0;
     }
+    return n;
+}
+
+int MTS_EncodeTuningChanges(unsigned char *buffer, int size, const double *freqs, double *lastFreqs, char program)
+{
+    if (!buffer || !freqs || !lastFreqs)
+        return 0;
     
-    ~mtsmasterglobal()
+    char midinotes[128];
+    unsigned char words[128][3];
+    int numChanged = 0;
+    for (int i = 0; i < 128; i++)
     {
-        if (handle)
-            dlclose(handle);
+        unsigned char last[3];
+        mtssysexencoder::encodeFreq(freqs[i], words[numChanged]);
+        mtssysexencoder::encodeFreq(lastFreqs[i], last);
+        if (lastFreqs[i] > 0.0 && mtssysexencoder::sameWord(words[numChanged], last))
+            continue;
+        midinotes[numChanged++] = static_cast<char>(i);
     }
     
-    void *handle;
-#endif
-};
+    int numWritten = 0;
+    int n = mtssysexencoder::noteTunings(buffer, size, midinotes, words, numChanged, -1, program, true, numWritten);
+    for (int i = 0; i < numWritten; i++)
+        lastFreqs[midinotes[i] & 127] = freqs[midinotes[i] & 127];
+    return n;
+}
 
-static mtsmasterglobal global;
-
-void MTS_RegisterMaster()                                                               {if (global.RegisterMaster) global.RegisterMaster(0);}
-void MTS_DeregisterMaster()                                                             {if (global.DeregisterMaster) global.DeregisterMaster();}
-bool MTS_CanRegisterMaster()                                                            {return global.HasMaster ? !global.HasMaster() : true;}
-bool MTS_HasIPC()                                                                       {return global.HasIPC ? global.HasIPC() : false;}
-void MTS_Reinitialize()                                                                 {if (global.Reinitialize) global.Reinitialize();}
-bool MTS_Master_ShouldUpdateLibrary()                                                   {return global.GetVersionNumber ? (global.GetVersionNumber() < libMTSVersion) : false;}
-int  MTS_GetNumClients()                                                                {return global.GetNumClients ? global.GetNumClients() : 0;}
-void MTS_SetNoteTunings(const double *freqs)                                            {if (global.SetNoteTunings) global.SetNoteTunings(freqs);}
-void MTS_SetNoteTuning(double freq, char midinote)                                      {if (global.SetNoteTuning) global.SetNoteTuning(freq, midinote);}
-void MTS_SetScaleName(const char *name)                                                 {if (global.SetScaleName) global.SetScaleName(name);}
-void MTS_SetPeriodRatio(double periodRatio)                                             {if (global.SetPeriodRatio) global.SetPeriodRatio(periodRatio);}
-void MTS_SetMapSize(signed char size)                                                   {if (global.SetMapSize) global.SetMapSize(size);}
-void MTS_SetMapStartKey(signed char key)                                                {if (global.SetMapStartKey) global.SetMapStartKey(key);}
-void MTS_SetRefKey(signed char key)                                                     {if (global.SetRefKey) global.SetRefKey(key);}
-void MTS_FilterNote(bool doFilter, char midinote, signed char midichannel)              {if (global.FilterNote) global.FilterNote(doFilter, midinote, midichannel);}
-void MTS_ClearNoteFilter()                                                              {if (global.ClearNoteFilter) global.ClearNoteFilter();}
-void MTS_SetMultiChannel(bool set, signed char midichannel)                             {if (global.SetMultiChannel) global.SetMultiChannel(set, midichannel);}
-void MTS_SetMultiChannelNoteTunings(const double *freqs, signed char midichannel)       {if (global.SetMultiChannelNoteTunings) global.SetMultiChannelNoteTunings(freqs, midichannel);}
-void MTS_SetMultiChannelNoteTuning(double freq, char midinote, signed char midichannel) {if (global.SetMultiChannelNoteTuning) global.SetMultiChannelNoteTuning(freq, midinote, midichannel);}
-void MTS_FilterNoteMultiChannel(bool doFilter, char midinote, signed char midichannel)  {if (global.FilterNoteMultiChannel) global.FilterNoteMultiChannel(doFilter, midinote, midichannel);}
-void MTS_ClearNoteFilterMultiChannel(signed char midichannel)                           {if (global.ClearNoteFilterMultiChannel) global.ClearNoteFilterMultiChannel(midichannel);}
+int MTS_EncodeScaleOctave(unsigned char *buffer, int size, const double *cents, bool twoByte, unsigned short channelMask, bool realtime)
+{
+    return mtssysexencoder::scaleOctave(buffer, size, cents, twoByte, channelMask, realtime);
+}
@@ -40,6 +40,21 @@ extern "C" {
      OR
         MTS_SetNoteTuning(frequency_in_hz, midinote);
 
+     Clients are notified of every change to tunings, note filters, multi-channel use and period ratio via a
+     tuning generation counter maintained by libMTS, so there is no need to do anything further to signal a change.
+     libMTS also guards its tables with a sequence lock, so clients never read a table part way through a change.
+
+
+     To change several things at once, e.g. when loading a new scale, wrap the changes in:
+
+        MTS_BeginUpdate();
+        ... // any of the set/filter functions below
+        MTS_CommitUpdate();
+
+     Changes made between these calls are held locally and sent when MTS_CommitUpdate() is called, with one call per changed
+     tuning table rather than one per note. If supported by libMTS they are published together, so clients never see a mix of
+     old and new tuning. Calls may be nested, in which case changes are sent when the outermost update is committed.
+
 
      To tell clients to ignore a note, call:
 
@@ -132,7 +147,8 @@ extern "C" {
     extern void MTS_DeregisterMaster();
 
     // Check if a master plugin is already instanced before registering, as only one Master may be registered at any one time.
-    // Don't call MTS_RegisterMaster() if this returns false.
+    // Don't call MTS_RegisterMaster() if this returns false. Should two masters both find they can register, the reference
+    // libMTS registers only the first, ignores the other, and ignores MTS_DeregisterMaster() from any process but the first's.
     extern bool MTS_CanRegisterMaster();
 
     // Check if the process in which the master plug-in is running is using IPC for sharing MTS-ESP tuning data.
@@ -146,9 +162,20 @@ extern "C" {
     // Check if the MTS-ESP dynamic library needs to be updated to use all features in this version of the API.
     extern bool MTS_Master_ShouldUpdateLibrary();
 
+    // Makes the master find each libMTS function by calling lookup with its name, e.g. "MTS_SetNoteTunings", instead of opening
+    // the installed libMTS, so tests can run against stub functions. lookup returns null for functions it does not provide.
+    // Must be called before any other master function, and also applies to clients if built into the same binary.
+    // Returns false if libMTS has already been opened. To load libMTS from another location instead, set the environment
+    // variable MTS_ESP_LIBRARY_PATH to the full path of the library, which is tried before the installed one.
+    extern bool MTS_Master_SetLibraryLookup(void *(*lookup)(const char *name));
+
     // Returns the number of connected clients.
     extern int MTS_GetNumClients();
 
+    // Hold changes made by the set/filter functions below until MTS_CommitUpdate() is called, then publish them together.
+    extern void MTS_BeginUpdate();
+    extern void MTS_CommitUpdate();
+
     // Set frequencies for 128 MIDI notes.
     extern void MTS_SetNoteTunings(const double *freqs);
     extern void MTS_SetNoteTuning(double freq, char midinote);
@@ -192,6 +219,121 @@ extern "C" {
     extern void MTS_FilterNoteMultiChannel(bool doFilter, char midinote, signed char midichannel);
     extern void MTS_ClearNoteFilterMultiChannel(signed char midichannel);
 
+    //-------------------------------------------------------------------------------------------------------
+
+    // Optional set of functions for sample-accurate retuning, e.g. from automation.
+    // Schedule a change for a sample position on the host timeline, so clients can apply it at that exact sample whatever
+    // their block size, then call MTS_ApplyScheduledTunings() once per block with the position of the end of the block to
+    // write changes that are due to the tables, as if MTS_SetNoteTuning() or MTS_SetMultiChannelNoteTuning() were called.
+    // Changes must be scheduled in time order; one scheduled before the last is moved to the time of the last.
+    // sampleTime may fall between samples, e.g. when converted from musical time, and clients then apply the change at
+    // the nearest sample, rounding halves up.
+    // Range for midichannel argument is 0-15 for a multi-channel tuning table, or -1 for the main table.
+    // Up to 1024 changes may be pending, after which the oldest is applied immediately to make room.
+    extern void MTS_ScheduleNoteTuning(double freq, char midinote, signed char midichannel, double sampleTime);
+    extern void MTS_ApplyScheduledTunings(double sampleTime);
+    
+    // Discard all scheduled changes that have not been applied, e.g. when playback stops or jumps.
+    extern void MTS_ClearScheduledTunings();
+
+    //-------------------------------------------------------------------------------------------------------
+
+    // Optional set of functions for running several masters at once, e.g. one per instrument group in a session.
+    // libMTS holds 16 tuning slots, each with its own master, tuning tables, note filters, scale information and schedule.
+    // Each function below is as the function of the same name without "Slot_", but acts on the slot given, 0-15. The
+    // functions without a slot argument act on slot 0, so a master that only uses those works as before. Clients see
+    // slot 0 unless bound to another slot with MTS_BindClientToSlot(). MTS_Reinitialize() resets every slot.
+    // The master's state for a slot is allocated when the slot is first used, so call MTS_Slot_CanRegisterMaster() and
+    // MTS_Slot_RegisterMaster() before using a slot from the audio thread. MTS_Slot_CanRegisterMaster() returns false for
+    // slots other than 0 if libMTS is too old to support slots.
+    extern void MTS_Slot_RegisterMaster(int slot);
+    extern void MTS_Slot_DeregisterMaster(int slot);
+    extern bool MTS_Slot_CanRegisterMaster(int slot);
+    extern void MTS_Slot_BeginUpdate(int slot);
+    extern void MTS_Slot_CommitUpdate(int slot);
+    extern void MTS_Slot_SetNoteTunings(int slot, const double *freqs);
+    extern void MTS_Slot_SetNoteTuning(int slot, double freq, char midinote);
+    extern void MTS_Slot_SetScaleName(int slot, const char *name);
+    extern void MTS_Slot_SetPeriodRatio(int slot, double periodRatio);
+    extern void MTS_Slot_SetMapSize(int slot, signed char size);
+    extern void MTS_Slot_SetMapStartKey(int slot, signed char key);
+    extern void MTS_Slot_SetRefKey(int slot, signed char key);
+    extern void MTS_Slot_FilterNote(int slot, bool doFilter, char midinote, signed char midichannel);
+    extern void MTS_Slot_ClearNoteFilter(int slot);
+    extern void MTS_Slot_SetMultiChannel(int slot, bool set, signed char midichannel);
+    extern void MTS_Slot_SetMultiChannelNoteTunings(int slot, const double *freqs, signed char midichannel);
+    extern void MTS_Slot_SetMultiChannelNoteTuning(int slot, double freq, char midinote, signed char midichannel);
+    extern void MTS_Slot_FilterNoteMultiChannel(int slot, bool doFilter, char midinote, signed char midichannel);
+    extern void MTS_Slot_ClearNoteFilterMultiChannel(int slot, signed char midichannel);
+    extern void MTS_Slot_ScheduleNoteTuning(int slot, double freq, char midinote, signed char midichannel, double sampleTime);
+    extern void MTS_Slot_ApplyScheduledTunings(int slot, double sampleTime);
+    extern void MTS_Slot_ClearScheduledTunings(int slot);
+
+    //-------------------------------------------------------------------------------------------------------
+
+    // Optional diagnostics, e.g. for finding which plug-in is making the most calls in a large session.
+    // Whilst enabled, every client counts its calls to the MTS-ESP client API. Counters start from zero when enabled
+    // and are approximate. Compare successive values to find rates. Clients built with an older version of the API,
+    // or connected to an older libMTS, are not included. Disabled by default, as counting has a small cost per query.
+    // Clients claim an entry for their counters when they register, so with more clients than libMTS has entries for,
+    // those that registered last are not included until they next call MTS_Client_ShouldUpdateLibrary() or
+    // MTS_WaitForTuningChange() after another client deregisters.
+    enum MTSDiagnosticCounter
+    {
+        MTS_Diag_FrequencyQueries = 0,      // MTS_NoteToFrequency()
+        MTS_Diag_RatioQueries,              // MTS_RetuningAsRatio()
+        MTS_Diag_SemitoneQueries,           // MTS_RetuningInSemitones()
+        MTS_Diag_FloatAndFixedPointQueries, // single precision and Q16.16 single note queries
+        MTS_Diag_BatchQueries,              // calls to any batch retuning function
+        MTS_Diag_BatchNotes,                // notes queried by batch retuning functions
+        MTS_Diag_Snapshots,                 // MTS_GetTuningSnapshot()
+        MTS_Diag_FilterQueries,             // MTS_ShouldFilterNote()
+        MTS_Diag_FrequencyToNoteQueries,    // frequencies looked up by MTS_FrequencyToNote() and related functions
+        MTS_Diag_MultiChannelTableHits,     // notes retuned with a multi-channel table
+        MTS_Diag_MainTableHits,             // notes retuned with the main table
+        MTS_Diag_LocalTableHits,            // notes retuned without a master, e.g. with tuning received via MTS SysEx
+        MTS_Diag_TableRefreshes,            // copies of tables taken by the client after a change by the master
+        MTS_Diag_NoteIndexRebuilds,         // note indices rebuilt by MTS_FrequencyToNote() and related functions
+        MTS_Diag_SysExBytes,                // bytes passed to MTS_ParseMIDIData()
+        MTS_NumDiagnosticCounters
+    };
+
+    extern void MTS_EnableClientDiagnostics(bool enable);
+
+    // Fills processIDs with the process ID of each client counting calls, and counters with MTS_NumDiagnosticCounters
+    // values for each client, one client after another. Either may be null. Returns the number of clients, up to maxClients.
+    // Process IDs are as seen by the client, so may not match the master's view of a process in a sandboxed host.
+    extern int MTS_GetClientDiagnostics(int *processIDs, unsigned int *counters, int maxClients);
+
+    //-------------------------------------------------------------------------------------------------------
+
+    // Optional set of functions for encoding tuning as MIDI Tuning Standard SysEx, e.g. for hardware synths or clients not
+    // connected to a master. These don't require MTS-ESP and don't change the tuning sent to clients.
+    // Messages are written to buffer, which holds size bytes, and the number of bytes written is returned, or 0 if the
+    // buffer is too small. Nothing is allocated, so these are safe to call from the audio thread.
+    // Frequencies outside the MIDI note range, including infinite ones, are clamped to it, and zero, negative and NaN
+    // frequencies give the lowest note. MTS has a resolution of 100/16384 cents.
+
+    // Bulk tuning dump of 128 frequencies (408 bytes, or 409 with a bank). name is padded or truncated to 16 characters.
+    // Supply -1 for bank to use the format without a bank number.
+    extern int MTS_EncodeBulkDump(unsigned char *buffer, int size, const double *freqs, const char *name, signed char bank, char program);
+
+    // Single note tuning changes for numNotes notes, freqs holding the frequency of each note in midinotes. Notes are packed
+    // into messages of up to 127 notes, each taking 8 bytes plus 4 per note, or 9 plus 4 with a bank. Supply -1 for bank to
+    // use the realtime format without a bank number, else realtime selects between the realtime and non-realtime formats.
+    extern int MTS_EncodeNoteTunings(unsigned char *buffer, int size, const char *midinotes, const double *freqs, int numNotes, signed char bank, char program, bool realtime);
+
+    // As MTS_EncodeNoteTunings() in realtime format, but only for notes in freqs whose encoded tuning differs from lastFreqs,
+    // minimising bandwidth on slow MIDI links. lastFreqs holds 128 frequencies last sent, and is updated with those written.
+    // A value of zero or less in lastFreqs means the note is always sent. If the buffer is too small, the notes that don't
+    // fit are sent by the next call.
+    extern int MTS_EncodeTuningChanges(unsigned char *buffer, int size, const double *freqs, double *lastFreqs, char program);
+
+    // Scale/octave tuning, giving the detune of each of the 12 pitch classes from C in cents, either one byte per pitch class
+    // (-64 to +63 cents, 21 bytes) or two bytes (-100 to +100 cents, 33 bytes). channelMask has a bit set for each MIDI channel
+    // the message applies to.
+    extern int MTS_EncodeScaleOctave(unsigned char *buffer, int size, const double *cents, bool twoByte, unsigned short channelMask, bool realtime);
+
 #ifdef __cplusplus
 }
 #endif
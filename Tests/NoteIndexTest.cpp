@@ -0,0 +1,196 @@
+/*
+Copyright (C) 2021 by ODDSound Ltd. info@oddsound.com
+
+Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF
+THIS SOFTWARE.
+*/
+
+// Checks, against the stand-in libMTS, that MTS_FrequencyToNote() and its variants find the same note as a search of every
+// note would: just below and just above the midpoint between each pair of neighbouring frequencies, below the lowest and
+// above the highest, on notes sharing a frequency and with notes filtered out, and that the index follows the master's
+// changes. Returns non-zero if any check fails.
+
+#include "libMTSClient.h"
+#include "StandInLibMTS.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+static int failures = 0;
+
+static void check(bool condition, const char *what, double freq)
+{
+    if (!condition)
+    {
+        printf("FAILED: %s for %.17g\n", what, freq);
+        failures++;
+    }
+}
+
+// The lowest note of those nearest freq by ratio, ignoring notes with filtered set, or -1 if every note is filtered.
+static int nearestNote(const double *freqs, const bool *filtered, double freq)
+{
+    int nearest = -1;
+    for (int i = 0; i < 128; i++)
+    {
+        if (filtered[i])
+            continue;
+        if (nearest < 0 || fabs(log(freqs[i] / freq)) < fabs(log(freqs[nearest] / freq)))
+            nearest = i;
+    }
+    return nearest;
+}
+
+// Checks freqs just either side of the geometric midpoint between every pair of neighbouring distinct frequencies,
+// and beyond both ends, against the search of every note.
+static void checkBoundaries(MTSClient *client, const double *freqs, const bool *filtered, signed char channel, const char *what)
+{
+    double sorted[128];
+    int size = 0;
+    for (int i = 0; i < 128; i++)
+        if (!filtered[i])
+            sorted[size++] = freqs[i];
+    std::sort(sorted, sorted + size);
+    size = static_cast<int>(std::unique(sorted, sorted + size) - sorted);
+
+    double probes[2 * 128 + 4];
+    int numProbes = 0;
+    probes[numProbes++] = sorted[0] * 0.5;
+    probes[numProbes++] = sorted[0];
+    probes[numProbes++] = sorted[size - 1];
+    probes[numProbes++] = sorted[size - 1] * 2.0;
+    for (int i = 0; i + 1 < size; i++)
+    {
+        double midpoint = sqrt(sorted[i] * sorted[i + 1]);
+        probes[numProbes++] = midpoint * (1.0 - 1e-9);
+        probes[numProbes++] = midpoint * (1.0 + 1e-9);
+    }
+
+    for (int i = 0; i < numProbes; i++)
+        check(MTS_FrequencyToNote(client, probes[i], channel) == nearestNote(freqs, filtered, probes[i]), what, probes[i]);
+}
+
+// Notes a quarter tone apart with their order scrambled, two pairs of notes sharing a frequency, and a gap.
+static void scrambledTuning(double *freqs)
+{
+    for (int i = 0; i < 128; i++)
+        freqs[i] = 440.0 * pow(2.0, ((i * 37) % 128 - 64) / 24.0);
+    freqs[90] = freqs[10];
+    freqs[91] = freqs[10];
+    freqs[100] = freqs[20];
+    freqs[30] = freqs[31] * 1.5;
+}
+
+static void setTuning(const double *freqs)
+{
+    stub::beginWrite();
+    for (int i = 0; i < 128; i++)
+        stub::slots[0].tuning[i] = freqs[i];
+    stub::logChange(0, -1, -1, 0.0);
+    stub::endWrite();
+}
+
+static void checkOffline(MTSClient *client)
+{
+    check(MTS_FrequencyToNote(client, 440.0, -1) == 69, "local tuning", 440.0);
+    check(MTS_FrequencyToNote(client, 440.0 * pow(2.0, 0.49 / 12.0), -1) == 69, "local tuning below the midpoint", 440.0);
+    check(MTS_FrequencyToNote(client, 440.0 * pow(2.0, 0.51 / 12.0), -1) == 70, "local tuning above the midpoint", 440.0);
+    check(MTS_FrequencyToNote(client, 1.0, -1) == 0, "local tuning below the lowest note", 1.0);
+    check(MTS_FrequencyToNote(client, 30000.0, -1) == 127, "local tuning above the highest note", 30000.0);
+
+    signed char channel = -1;
+    check(MTS_FrequencyToNoteAndChannel(client, 440.0, &channel) == 69 && channel == 0, "local tuning with a channel", 440.0);
+}
+
+static void checkMainTable(MTSClient *client)
+{
+    double freqs[128];
+    bool filtered[128] = {false};
+    scrambledTuning(freqs);
+    setTuning(freqs);
+    checkBoundaries(client, freqs, filtered, -1, "scrambled tuning");
+    check(MTS_FrequencyToNote(client, freqs[10], -1) == 10, "lowest of three notes sharing a frequency", freqs[10]);
+    check(MTS_FrequencyToNote(client, freqs[20], -1) == 20, "lowest of two notes sharing a frequency", freqs[20]);
+
+    // the index is rebuilt on every change
+    stub::setNoteTuning(12345.0, 5);
+    freqs[5] = 12345.0;
+    checkBoundaries(client, freqs, filtered, -1, "after retuning a note");
+
+    stub::filterNote(true, 10);
+    stub::filterNote(true, 64);
+    filtered[10] = true;
+    filtered[64] = true;
+    checkBoundaries(client, freqs, filtered, -1, "with notes filtered");
+    check(MTS_FrequencyToNote(client, freqs[10], -1) == 90, "note sharing the frequency of a filtered note", freqs[10]);
+
+    // filtered on one channel only
+    stub::filterNote(false, 64);
+    stub::filterNote(true, 64, 2);
+    filtered[64] = false;
+    checkBoundaries(client, freqs, filtered, 3, "on a channel without the filter");
+    filtered[64] = true;
+    checkBoundaries(client, freqs, filtered, 2, "on the channel with the filter");
+    stub::filterNote(false, 64, 2);
+    stub::filterNote(false, 10);
+}
+
+static void checkMultiChannel(MTSClient *client)
+{
+    stub::registerMaster();
+    double offset = pow(2.0, 40.0 / 1200.0);
+    stub::beginWrite();
+    for (int i = 0; i < 128; i++)
+        stub::slots[0].multiChannelTunings[128 * 1 + i] = stub::slots[0].tuning[i] * offset;
+    stub::slots[0].multiChannelInUse[0] = true;
+    stub::slots[0].multiChannelInUse[1] = true;
+    stub::endWrite();
+
+    double freqs[128];
+    bool filtered[128] = {false};
+    for (int i = 0; i < 128; i++)
+        freqs[i] = stub::slots[0].multiChannelTunings[128 * 1 + i];
+    checkBoundaries(client, freqs, filtered, 1, "multi-channel table");
+
+    signed char channel = -1;
+    check(MTS_FrequencyToNoteAndChannel(client, 440.0, &channel) == 69 && channel == 0, "note on the first channel", 440.0);
+    check(MTS_FrequencyToNoteAndChannel(client, 440.0 * offset, &channel) == 69 && channel == 1, "note on the second channel", 440.0 * offset);
+    check(MTS_FrequencyToNoteAndChannel(client, 440.0 * offset * 1.001, &channel) == 69 && channel == 1, "nearest note over both channels", 440.0 * offset);
+
+    // simultaneous frequencies are given distinct notes, so equal frequencies go to the next nearest
+    double partials[3] = {440.0, 440.0, 440.0};
+    char notes[3];
+    signed char channels[3];
+    MTS_FrequenciesToNotesAndChannels(client, partials, notes, channels, 3);
+    check(notes[0] == 69 && channels[0] == 0, "first of three equal frequencies", 440.0);
+    check(notes[1] == 69 && channels[1] == 1, "second of three equal frequencies", 440.0);
+    check(notes[2] == 68 && channels[2] == 1, "third of three equal frequencies", 440.0);
+
+    stub::beginWrite();
+    stub::slots[0].multiChannelInUse[0] = false;
+    stub::slots[0].multiChannelInUse[1] = false;
+    stub::endWrite();
+    MTS_FrequenciesToNotesAndChannels(client, partials, notes, channels, 2);
+    check(notes[0] == 69 && channels[0] == 0 && notes[1] != 69 && channels[1] == 0, "equal frequencies without multi-channel tables", 440.0);
+}
+
+int main()
+{
+    check(MTS_Client_SetLibraryLookup(stub::lookup), "installing the stand-in libMTS", 0.0);
+    MTSClient *client = MTS_RegisterClient();
+
+    checkOffline(client);
+    stub::registerMaster();
+    checkMainTable(client);
+    checkMultiChannel(client);
+
+    stub::deregisterMaster();
+    checkOffline(client);
+    MTS_DeregisterClient(client);
+
+    if (failures == 0)
+        printf("All note index checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+/*
+Copyright (C) 2021 by ODDSound Ltd. info@oddsound.com
+
+Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF
+THIS SOFTWARE.
+*/
+
+// Checks, against the stand-in libMTS, that MTS_NoteToPitchBend() gives the nearest note and the pitch bend to reach the
+// retuned frequency from it for the bend range set, clamped at the ends of the MIDI note and pitch bend ranges, that
+// results follow the master's changes and the bend range, and that output channels rotate and are only reused once every
+// channel holds a note. Returns non-zero if any check fails.
+
+#include "libMTSClient.h"
+#include "StandInLibMTS.h"
+#include <math.h>
+#include <stdio.h>
+
+static int failures = 0;
+
+static void check(bool condition, const char *what, int value)
+{
+    if (!condition)
+    {
+        printf("FAILED: %s, got %d\n", what, value);
+        failures++;
+    }
+}
+
+static double semitonesAbove(double semitones, int note) {return stub::equalTempered(note) * pow(2.0, semitones / 12.0);}
+
+static void checkBend(MTSClient *client, char note, signed char channel, int expectedNote, int expectedBend, const char *what)
+{
+    char outNote = -1;
+    signed char outChannel = -1;
+    int bend = -1;
+    MTS_NoteToPitchBend(client, note, channel, &outNote, &outChannel, &bend);
+    MTS_ReleasePitchBendChannel(client, outChannel);
+    check(outNote == expectedNote, what, outNote);
+    check(bend == expectedBend, what, bend);
+}
+
+static void checkBends(MTSClient *client)
+{
+    MTS_SetPitchBendOutput(client, 2.0, 1, 15);
+    checkBend(client, 69, -1, 69, 8192, "local tuning");
+
+    stub::registerMaster();
+    checkBend(client, 69, -1, 69, 8192, "equal temperament");
+
+    stub::setNoteTuning(semitonesAbove(0.25, 69), 69);
+    checkBend(client, 69, -1, 69, 8192 + 1024, "quarter semitone up");
+
+    stub::setNoteTuning(semitonesAbove(0.75, 69), 69);
+    checkBend(client, 69, -1, 70, 8192 - 1024, "three quarters of a semitone up, from the next note");
+
+    stub::setNoteTuning(semitonesAbove(-3.0, 69), 69);
+    checkBend(client, 69, -1, 66, 8192, "three semitones down");
+
+    // nearest notes are clamped to 0-127, and bends to 0-16383
+    stub::setNoteTuning(30000.0, 127);
+    checkBend(client, 127, -1, 127, 8192 + 2048, "above the highest note");
+    stub::setNoteTuning(1.0, 0);
+    checkBend(client, 0, -1, 0, 8192 - 2048, "below the lowest note");
+    MTS_SetPitchBendOutput(client, 0.25, 1, 15);
+    checkBend(client, 127, -1, 127, 16383, "beyond the top of the bend range");
+    checkBend(client, 0, -1, 0, 0, "beyond the bottom of the bend range");
+
+    // the tables are rebuilt for a new bend range
+    MTS_SetPitchBendOutput(client, 48.0, 1, 15);
+    checkBend(client, 127, -1, 127, 8192 + 85, "above the highest note with a range of 48 semitones");
+    stub::setNoteTuning(semitonesAbove(0.25, 69), 69);
+    checkBend(client, 69, -1, 69, 8192 + 43, "quarter semitone up with a range of 48 semitones");
+
+    // multi-channel tables are used for a channel with one in use
+    stub::setNoteTuning(semitonesAbove(-0.4, 60), 60, 4);
+    stub::setMultiChannel(true, 4);
+    checkBend(client, 60, 4, 60, 8192 - 68, "multi-channel table");
+    checkBend(client, 60, 5, 60, 8192, "channel without a multi-channel table");
+}
+
+static void checkChannels(MTSClient *client)
+{
+    MTS_SetPitchBendOutput(client, 48.0, 2, 3);
+
+    signed char channels[5];
+    for (int i = 0; i < 5; i++)
+        MTS_NoteToPitchBend(client, 60, -1, 0, &channels[i], 0);
+    check(channels[0] == 2 && channels[1] == 3 && channels[2] == 4, "channels taken in turn", channels[0]);
+    check(channels[3] == 2 && channels[4] == 3, "channels reused in turn once every channel holds a note", channels[3]);
+
+    // channels 2 and 4 still hold a note each after a release from channel 2, so the next in turn is reused
+    MTS_ReleasePitchBendChannel(client, 2);
+    signed char channel = -1;
+    MTS_NoteToPitchBend(client, 60, -1, 0, &channel, 0);
+    check(channel == 4, "channel reused in turn after a release", channel);
+
+    MTS_ReleasePitchBendChannel(client, 3);
+    MTS_ReleasePitchBendChannel(client, 3);
+    MTS_NoteToPitchBend(client, 60, -1, 0, &channel, 0);
+    check(channel == 3, "released channel", channel);
+
+    // more channels than there are from the first channel up
+    MTS_SetPitchBendOutput(client, 48.0, 14, 5);
+    for (int i = 0; i < 3; i++)
+        MTS_NoteToPitchBend(client, 60, -1, 0, &channels[i], 0);
+    check(channels[0] == 14 && channels[1] == 15 && channels[2] == 14, "channels limited to 15", channels[2]);
+}
+
+int main()
+{
+    check(MTS_Client_SetLibraryLookup(stub::lookup), "installing the stand-in libMTS", 0);
+    MTSClient *client = MTS_RegisterClient();
+
+    checkBends(client);
+    checkChannels(client);
+
+    stub::deregisterMaster();
+    MTS_DeregisterClient(client);
+
+    if (failures == 0)
+        printf("All pitch bend checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,340 @@
+/*
+Copyright (C) 2021 by ODDSound Ltd. info@oddsound.com
+
+Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF
+THIS SOFTWARE.
+*/
+
+#ifndef StandInLibMTS_h
+#define StandInLibMTS_h
+
+/*
+ A stand-in libMTS for the tests and the benchmark, installed with MTS_Client_SetLibraryLookup(stub::lookup) before the
+ first client registers. It publishes its tables, flags, masks, sequence and generation in process memory exactly as the
+ reference libMTS does, so clients take the same paths as with a real master, and keeps the change log and schedule of
+ each slot in small rings. The functions after lookup() act as the master, in slot 0 unless given another. It is for
+ one thread only: the master functions are never called whilst a client is querying.
+*/
+
+#include <math.h>
+#include <string.h>
+
+namespace stub
+{
+    enum {eNumSlots = 16, eChangeLogSize = 64, eScheduleSize = 64};
+
+    struct change
+    {
+        unsigned int generation;
+        signed char midichannel;
+        signed char midinote; // -1 for a change to a whole table
+        double freq;
+    };
+
+    struct scheduledChange
+    {
+        double time;
+        signed char midichannel;
+        signed char midinote;
+        double freq;
+    };
+
+    struct slot
+    {
+        double tuning[128];
+        double multiChannelTunings[16 * 128];
+        bool multiChannelInUse[16];
+        unsigned int noteFilterMasks[17 * 4];       // as in libMTS, 0-15 combine the main filter with each channel's
+        unsigned int multiChannelNoteFilterMasks[16 * 4];
+        volatile unsigned int sequence;
+        volatile unsigned int hasMaster;
+        volatile unsigned int generation;
+
+        change changes[eChangeLogSize];
+        unsigned int changeHead;
+
+        scheduledChange schedule[eScheduleSize];
+        unsigned int scheduleHead;
+        unsigned int scheduleStart;
+    };
+
+    static slot slots[eNumSlots];
+
+    static inline bool validChannel(signed char midichannel) {return !(midichannel & ~15);}
+    static inline double equalTempered(int note) {return 440.0 * pow(2.0, (note - 69.0) / 12.0);}
+
+    static void beginWrite(int s = 0)   {slots[s].sequence = slots[s].sequence + 1;}
+    static void endWrite(int s = 0)     {slots[s].generation = slots[s].generation + 1; slots[s].sequence = slots[s].sequence + 1;}
+
+    // Records a change, which becomes visible to clients in the generation committed by the next endWrite().
+    static void logChange(int s, signed char midichannel, signed char midinote, double freq)
+    {
+        change &c = slots[s].changes[slots[s].changeHead++ % eChangeLogSize];
+        c.generation = slots[s].generation + 1;
+        c.midichannel = midichannel;
+        c.midinote = midinote;
+        c.freq = freq;
+    }
+
+    // client, in a slot
+    static bool SlotShouldFilterNote(int s, char midinote, signed char midichannel)
+    {
+        int i = validChannel(midichannel) ? midichannel : 16;
+        return (slots[s].noteFilterMasks[4 * i + ((midinote & 127) >> 5)] >> (midinote & 31)) & 1;
+    }
+
+    static bool SlotShouldFilterNoteMultiChannel(int s, char midinote, signed char midichannel)
+    {
+        return validChannel(midichannel) && ((slots[s].multiChannelNoteFilterMasks[4 * midichannel + ((midinote & 127) >> 5)] >> (midinote & 31)) & 1);
+    }
+
+    static const double *SlotGetTuningTable(int s)                                  {return slots[s].tuning;}
+    static const double *SlotGetMultiChannelTuningTable(int s, signed char midichannel) {return validChannel(midichannel) ? slots[s].multiChannelTunings + 128 * midichannel : 0;}
+    static bool SlotUseMultiChannelTuning(int s, signed char midichannel)           {return validChannel(midichannel) && slots[s].multiChannelInUse[midichannel];}
+    static const char *SlotGetScaleName(int)                                        {return "12-TET";}
+    static double SlotGetPeriodRatio(int)                                           {return 2.0;}
+    static signed char SlotGetMapSize(int)                                          {return -1;}
+    static signed char SlotGetMapStartKey(int)                                      {return -1;}
+    static signed char SlotGetRefKey(int)                                           {return -1;}
+    static unsigned int SlotGetTuningGeneration(int s)                              {return slots[s].generation;}
+    static const volatile unsigned int *SlotGetTuningSequence(int s)                {return &slots[s].sequence;}
+    static const volatile unsigned int *SlotGetHasMasterFlag(int s)                 {return &slots[s].hasMaster;}
+    static unsigned int SlotWaitForTuningChange(int s, unsigned int, int)           {return slots[s].generation;}
+    static const volatile unsigned int *SlotGetNoteFilterMasks(int s)               {return slots[s].noteFilterMasks;}
+    static const volatile unsigned int *SlotGetMultiChannelNoteFilterMasks(int s)   {return slots[s].multiChannelNoteFilterMasks;}
+    static const double *SlotGetMultiChannelTuningTables(int s)                     {return slots[s].multiChannelTunings;}
+
+    // As in libMTS: the latest frequency of each note retuned after sinceGeneration, newest first, or -1 if every note
+    // must be treated as changed.
+    static int SlotGetTuningChanges(int s, unsigned int sinceGeneration, unsigned int *currentGeneration, char *midinotes, signed char *midichannels, double *freqs, int maxChanges)
+    {
+        const slot &sl = slots[s];
+        if (currentGeneration)
+            *currentGeneration = sl.generation;
+
+        bool seen[17][128];
+        memset(seen, 0, sizeof(seen));
+        int numChanges = 0;
+        for (unsigned int i = 1; i <= eChangeLogSize && i <= sl.changeHead; i++)
+        {
+            const change &c = sl.changes[(sl.changeHead - i) % eChangeLogSize];
+            if (static_cast<int>(c.generation - sinceGeneration) <= 0)
+                return numChanges;
+            if (c.midinote < 0)
+                return -1;
+
+            int table = validChannel(c.midichannel) ? c.midichannel : 16;
+            if (seen[table][c.midinote])
+                continue;
+            seen[table][c.midinote] = true;
+
+            if (numChanges == maxChanges)
+                return -1;
+            if (midinotes)
+                midinotes[numChanges] = static_cast<char>(c.midinote);
+            if (midichannels)
+                midichannels[numChanges] = validChannel(c.midichannel) ? c.midichannel : static_cast<signed char>(-1);
+            if (freqs)
+                freqs[numChanges] = c.freq;
+            numChanges++;
+        }
+        return -1;
+    }
+
+    // As in libMTS: the changes due within a block, each at the sample nearest its time, halves rounding up.
+    static int SlotGetScheduledTuningChanges(int s, double blockStart, int blockLength, int *offsets, char *midinotes, signed char *midichannels, double *freqs, int maxChanges)
+    {
+        const slot &sl = slots[s];
+        int numChanges = 0;
+        for (unsigned int position = sl.scheduleStart; position != sl.scheduleHead && numChanges < maxChanges; position++)
+        {
+            const scheduledChange &c = sl.schedule[position % eScheduleSize];
+            int offset = static_cast<int>(floor(c.time - blockStart + 0.5));
+            if (offset < 0)
+                continue;
+            if (offset >= blockLength)
+                break;
+            if (offsets)
+                offsets[numChanges] = offset;
+            if (midinotes)
+                midinotes[numChanges] = static_cast<char>(c.midinote);
+            if (midichannels)
+                midichannels[numChanges] = c.midichannel;
+            if (freqs)
+                freqs[numChanges] = c.freq;
+            numChanges++;
+        }
+        return numChanges;
+    }
+
+    // client, in slot 0
+    static void RegisterClient() {}
+    static void DeregisterClient() {}
+    static bool HasMaster()                                                 {return slots[0].hasMaster != 0;}
+    static bool ShouldFilterNote(char midinote, signed char midichannel)    {return SlotShouldFilterNote(0, midinote, midichannel);}
+    static bool ShouldFilterNoteMultiChannel(char midinote, signed char midichannel) {return SlotShouldFilterNoteMultiChannel(0, midinote, midichannel);}
+    static const double *GetTuningTable()                                   {return SlotGetTuningTable(0);}
+    static const double *GetMultiChannelTuningTable(signed char midichannel) {return SlotGetMultiChannelTuningTable(0, midichannel);}
+    static bool UseMultiChannelTuning(signed char midichannel)              {return SlotUseMultiChannelTuning(0, midichannel);}
+    static const char *GetScaleName()                                       {return SlotGetScaleName(0);}
+    static double GetPeriodRatio()                                          {return SlotGetPeriodRatio(0);}
+    static signed char GetMapSize()                                         {return SlotGetMapSize(0);}
+    static signed char GetMapStartKey()                                     {return SlotGetMapStartKey(0);}
+    static signed char GetRefKey()                                          {return SlotGetRefKey(0);}
+    static unsigned int GetTuningGeneration()                               {return SlotGetTuningGeneration(0);}
+    static const volatile unsigned int *GetTuningSequence()                 {return SlotGetTuningSequence(0);}
+    static const volatile unsigned int *GetHasMasterFlag()                  {return SlotGetHasMasterFlag(0);}
+    static unsigned int WaitForTuningChange(unsigned int lastGeneration, int timeoutMs) {return SlotWaitForTuningChange(0, lastGeneration, timeoutMs);}
+    static const volatile unsigned int *GetNoteFilterMasks()                {return SlotGetNoteFilterMasks(0);}
+    static const volatile unsigned int *GetMultiChannelNoteFilterMasks()    {return SlotGetMultiChannelNoteFilterMasks(0);}
+    static const double *GetMultiChannelTuningTables()                      {return SlotGetMultiChannelTuningTables(0);}
+
+    static int GetTuningChanges(unsigned int sinceGeneration, unsigned int *currentGeneration, char *midinotes, signed char *midichannels, double *freqs, int maxChanges)
+    {
+        return SlotGetTuningChanges(0, sinceGeneration, currentGeneration, midinotes, midichannels, freqs, maxChanges);
+    }
+
+    static int GetScheduledTuningChanges(double blockStart, int blockLength, int *offsets, char *midinotes, signed char *midichannels, double *freqs, int maxChanges)
+    {
+        return SlotGetScheduledTuningChanges(0, blockStart, blockLength, offsets, midinotes, midichannels, freqs, maxChanges);
+    }
+
+    struct symbol
+    {
+        const char *name;
+        void *function;
+    };
+
+    static const symbol symbols[] =
+    {
+        {"MTS_RegisterClient",                  reinterpret_cast<void*>(RegisterClient)},
+        {"MTS_DeregisterClient",                reinterpret_cast<void*>(DeregisterClient)},
+        {"MTS_HasMaster",                       reinterpret_cast<void*>(HasMaster)},
+        {"MTS_ShouldFilterNote",                reinterpret_cast<void*>(ShouldFilterNote)},
+        {"MTS_ShouldFilterNoteMultiChannel",    reinterpret_cast<void*>(ShouldFilterNoteMultiChannel)},
+        {"MTS_GetTuningTable",                  reinterpret_cast<void*>(GetTuningTable)},
+        {"MTS_GetMultiChannelTuningTable",      reinterpret_cast<void*>(GetMultiChannelTuningTable)},
+        {"MTS_UseMultiChannelTuning",           reinterpret_cast<void*>(UseMultiChannelTuning)},
+        {"MTS_GetScaleName",                    reinterpret_cast<void*>(GetScaleName)},
+        {"MTS_GetPeriodRatio",                  reinterpret_cast<void*>(GetPeriodRatio)},
+        {"MTS_GetMapSize",                      reinterpret_cast<void*>(GetMapSize)},
+        {"MTS_GetMapStartKey",                  reinterpret_cast<void*>(GetMapStartKey)},
+        {"MTS_GetRefKey",                       reinterpret_cast<void*>(GetRefKey)},
+        {"MTS_GetTuningGeneration",             reinterpret_cast<void*>(GetTuningGeneration)},
+        {"MTS_GetTuningSequence",               reinterpret_cast<void*>(GetTuningSequence)},
+        {"MTS_GetHasMasterFlag",                reinterpret_cast<void*>(GetHasMasterFlag)},
+        {"MTS_WaitForTuningChange",             reinterpret_cast<void*>(WaitForTuningChange)},
+        {"MTS_GetTuningChanges",                reinterpret_cast<void*>(GetTuningChanges)},
+        {"MTS_GetNoteFilterMasks",              reinterpret_cast<void*>(GetNoteFilterMasks)},
+        {"MTS_GetMultiChannelNoteFilterMasks",  reinterpret_cast<void*>(GetMultiChannelNoteFilterMasks)},
+        {"MTS_GetScheduledTuningChanges",       reinterpret_cast<void*>(GetScheduledTuningChanges)},
+        {"MTS_GetMultiChannelTuningTables",     reinterpret_cast<void*>(GetMultiChannelTuningTables)},
+        {"MTS_Slot_GetTuningTable",             reinterpret_cast<void*>(SlotGetTuningTable)},
+        {"MTS_Slot_GetMultiChannelTuningTable", reinterpret_cast<void*>(SlotGetMultiChannelTuningTable)},
+        {"MTS_Slot_UseMultiChannelTuning",      reinterpret_cast<void*>(SlotUseMultiChannelTuning)},
+        {"MTS_Slot_GetScaleName",               reinterpret_cast<void*>(SlotGetScaleName)},
+        {"MTS_Slot_GetPeriodRatio",             reinterpret_cast<void*>(SlotGetPeriodRatio)},
+        {"MTS_Slot_GetMapSize",                 reinterpret_cast<void*>(SlotGetMapSize)},
+        {"MTS_Slot_GetMapStartKey",             reinterpret_cast<void*>(SlotGetMapStartKey)},
+        {"MTS_Slot_GetRefKey",                  reinterpret_cast<void*>(SlotGetRefKey)},
+        {"MTS_Slot_GetTuningGeneration",        reinterpret_cast<void*>(SlotGetTuningGeneration)},
+        {"MTS_Slot_GetTuningSequence",          reinterpret_cast<void*>(SlotGetTuningSequence)},
+        {"MTS_Slot_GetHasMasterFlag",           reinterpret_cast<void*>(SlotGetHasMasterFlag)},
+        {"MTS_Slot_WaitForTuningChange",        reinterpret_cast<void*>(SlotWaitForTuningChange)},
+        {"MTS_Slot_GetTuningChanges",           reinterpret_cast<void*>(SlotGetTuningChanges)},
+        {"MTS_Slot_GetScheduledTuningChanges",  reinterpret_cast<void*>(SlotGetScheduledTuningChanges)},
+        {"MTS_Slot_GetNoteFilterMasks",         reinterpret_cast<void*>(SlotGetNoteFilterMasks)},
+        {"MTS_Slot_GetMultiChannelNoteFilterMasks", reinterpret_cast<void*>(SlotGetMultiChannelNoteFilterMasks)},
+        {"MTS_Slot_GetMultiChannelTuningTables", reinterpret_cast<void*>(SlotGetMultiChannelTuningTables)},
+    };
+
+    static void *lookup(const char *name)
+    {
+        for (size_t i = 0; i < sizeof(symbols) / sizeof(symbols[0]); i++)
+            if (!strcmp(symbols[i].name, name))
+                return symbols[i].function;
+        return 0;
+    }
+
+    // master
+    // Connects a master with equal-tempered tables and no notes filtered.
+    static void registerMaster(int s = 0)
+    {
+        slot &sl = slots[s];
+        beginWrite(s);
+        for (int i = 0; i < 128; i++)
+            sl.tuning[i] = equalTempered(i);
+        for (int c = 0; c < 16; c++)
+        {
+            sl.multiChannelInUse[c] = false;
+            memcpy(sl.multiChannelTunings + 128 * c, sl.tuning, sizeof(sl.tuning));
+        }
+        memset(sl.noteFilterMasks, 0, sizeof(sl.noteFilterMasks));
+        memset(sl.multiChannelNoteFilterMasks, 0, sizeof(sl.multiChannelNoteFilterMasks));
+        sl.scheduleStart = sl.scheduleHead;
+        logChange(s, -1, -1, 0.0);
+        sl.hasMaster = 1;
+        endWrite(s);
+    }
+
+    static void deregisterMaster(int s = 0)
+    {
+        beginWrite(s);
+        logChange(s, -1, -1, 0.0);
+        slots[s].hasMaster = 0;
+        endWrite(s);
+    }
+
+    // midichannel -1 for the main table, otherwise the channel's multi-channel table
+    static void setNoteTuning(double freq, int midinote, int midichannel = -1, int s = 0)
+    {
+        beginWrite(s);
+        if (midichannel < 0)
+            slots[s].tuning[midinote] = freq;
+        else
+            slots[s].multiChannelTunings[128 * midichannel + midinote] = freq;
+        logChange(s, static_cast<signed char>(midichannel), static_cast<signed char>(midinote), freq);
+        endWrite(s);
+    }
+
+    static void setMultiChannel(bool set, int midichannel, int s = 0)
+    {
+        beginWrite(s);
+        slots[s].multiChannelInUse[midichannel] = set;
+        endWrite(s);
+    }
+
+    // midichannel -1 filters the note on every channel, as MTS_FilterNote() does, otherwise on the channel and for queries
+    // without a channel. Masks are set directly, so filters on a note with and without a channel don't combine as in libMTS.
+    static void filterNote(bool doFilter, int midinote, int midichannel = -1, int s = 0)
+    {
+        beginWrite(s);
+        unsigned int bit = 1u << (midinote & 31);
+        for (int i = 0; i < 17; i++)
+        {
+            if (midichannel >= 0 && i != midichannel && i != 16)
+                continue;
+            unsigned int &word = slots[s].noteFilterMasks[4 * i + (midinote >> 5)];
+            word = doFilter ? (word | bit) : (word & ~bit);
+        }
+        endWrite(s);
+    }
+
+    static void scheduleNoteTuning(double freq, int midinote, int midichannel, double sampleTime, int s = 0)
+    {
+        slot &sl = slots[s];
+        if (sl.scheduleHead - sl.scheduleStart == eScheduleSize)
+            sl.scheduleStart++;
+        scheduledChange &c = sl.schedule[sl.scheduleHead++ % eScheduleSize];
+        c.time = sampleTime;
+        c.midichannel = static_cast<signed char>(midichannel);
+        c.midinote = static_cast<signed char>(midinote);
+        c.freq = freq;
+    }
+
+    static void clearScheduledTunings(int s = 0) {slots[s].scheduleStart = slots[s].scheduleHead;}
+}
+
+#endif
@@ -0,0 +1,137 @@
+/*
+Copyright (C) 2021 by ODDSound Ltd. info@oddsound.com
+
+Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF
+THIS SOFTWARE.
+*/
+
+// Checks that every tuning word of bulk dump and scale/octave messages decodes to within maxRelativeError of
+// 440 * pow(2, (note + detune - 69) / 12), over the full range of detune values each format can carry, and that
+// messages decoded whole and messages split into single bytes give identical frequencies. The client runs without
+// libMTS, so received tuning is read back unchanged from its local table. Returns non-zero if any check fails.
+
+#include "libMTSClient.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+static const double maxRelativeError = 5.0 * DBL_EPSILON; // 5 ulp
+
+static int failures = 0;
+static double worstError = 0.0;
+
+static void *noLibrary(const char *) {return 0;}
+
+static void check(bool condition, const char *what, int value)
+{
+    if (!condition)
+    {
+        printf("FAILED: %s for %d\n", what, value);
+        failures++;
+    }
+}
+
+static void checkFrequency(double freq, double semitonesFrom69, int value)
+{
+    double expected = 440.0 * pow(2.0, semitonesFrom69 / 12.0);
+    double error = fabs(freq - expected) / expected;
+    if (error > worstError)
+        worstError = error;
+    check(error <= maxRelativeError, "frequency", value);
+}
+
+// Parses a message whole, then again a byte at a time, and checks both give the same frequencies.
+static void parse(MTSClient *client, const std::vector<unsigned char> &message, double *freqs, int value)
+{
+    MTS_ParseMIDIDataU(client, &message[0], static_cast<int>(message.size()));
+    for (int i = 0; i < 128; i++)
+        freqs[i] = MTS_NoteToFrequency(client, static_cast<char>(i), -1);
+
+    // a message with other frequencies in between, so the next one has to change every note
+    unsigned char reset[] = {0xF0, 0x7F, 0x7F, 0x08, 0x08, 0x03, 0x7F, 0x7F, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xF7};
+    MTS_ParseMIDIDataU(client, reset, sizeof(reset));
+
+    for (size_t i = 0; i < message.size(); i++)
+        MTS_ParseMIDIDataU(client, &message[i], 1);
+    for (int i = 0; i < 128; i++)
+        check(MTS_NoteToFrequency(client, static_cast<char>(i), -1) == freqs[i], "whole and split messages", value);
+}
+
+// Bulk dumps with every detune value 0-16383 on note 60, 128 values per dump.
+static void checkBulkDumps(MTSClient *client)
+{
+    for (int dump = 0; dump < 128; dump++)
+    {
+        std::vector<unsigned char> message;
+        unsigned char header[] = {0xF0, 0x7E, 0x7F, 0x08, 0x01, 0x00};
+        message.insert(message.end(), header, header + sizeof(header));
+        message.insert(message.end(), 16, static_cast<unsigned char>('x'));
+        for (int i = 0; i < 128; i++)
+        {
+            int value = dump * 128 + i;
+            message.push_back(60);
+            message.push_back(static_cast<unsigned char>(value >> 7));
+            message.push_back(static_cast<unsigned char>(value & 127));
+        }
+        unsigned char checksum = 0;
+        for (size_t i = 1; i < message.size(); i++)
+            checksum ^= message[i];
+        message.push_back(checksum & 0x7F);
+        message.push_back(0xF7);
+
+        double freqs[128];
+        parse(client, message, freqs, dump);
+        for (int i = 0; i < 128; i++)
+            checkFrequency(freqs[i], 60.0 + (dump * 128 + i) / 16383.0 - 69.0, dump * 128 + i);
+    }
+}
+
+// Scale/octave messages with every one byte value 0-127, or every two byte value 0-16383, 12 values per message.
+static void checkScaleOctave(MTSClient *client, bool twoByte)
+{
+    int numValues = twoByte ? 16384 : 128;
+    for (int first = 0; first < numValues; first += 12)
+    {
+        std::vector<unsigned char> message;
+        unsigned char header[] = {0xF0, 0x7F, 0x7F, 0x08, static_cast<unsigned char>(twoByte ? 0x09 : 0x08), 0x03, 0x7F, 0x7F};
+        message.insert(message.end(), header, header + sizeof(header));
+        int values[12];
+        for (int i = 0; i < 12; i++)
+        {
+            values[i] = (first + i) % numValues;
+            if (twoByte)
+                message.push_back(static_cast<unsigned char>(values[i] >> 7));
+            message.push_back(static_cast<unsigned char>(values[i] & 127));
+        }
+        message.push_back(0xF7);
+
+        double freqs[128];
+        parse(client, message, freqs, first);
+        for (int i = 0; i < 128; i++)
+        {
+            int value = values[i % 12];
+            double detune = twoByte ? (value - 8192.0) / (value > 8192 ? 8191.0 : 8192.0) : (value - 64.0) * 0.01;
+            checkFrequency(freqs[i], i + detune - 69.0, value);
+        }
+    }
+}
+
+int main()
+{
+    check(MTS_Client_SetLibraryLookup(noLibrary), "installing the lookup", 0);
+    MTSClient *client = MTS_RegisterClient();
+
+    checkBulkDumps(client);
+    checkScaleOctave(client, false);
+    checkScaleOctave(client, true);
+
+    MTS_DeregisterClient(client);
+
+    printf("Largest relative error %g\n", worstError);
+    if (failures == 0)
+        printf("All SysEx decoder checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
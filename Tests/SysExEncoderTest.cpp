@@ -0,0 +1,83 @@
+/*
+Copyright (C) 2021 by ODDSound Ltd. info@oddsound.com
+
+Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF
+THIS SOFTWARE.
+*/
+
+// Checks that the MTS SysEx encoding functions clamp frequencies and cents outside the range MTS can represent, including
+// infinite and NaN values, rather than converting them to integers. Returns non-zero if any check fails.
+
+#include "libMTSMaster.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+
+static int failures = 0;
+
+static void check(bool condition, const char *what, double value)
+{
+    if (!condition)
+    {
+        printf("FAILED: %s for %g\n", what, value);
+        failures++;
+    }
+}
+
+// Encodes a single note tuning change in realtime format without a bank, and returns the three byte frequency word.
+static void encode(double freq, unsigned char *word)
+{
+    unsigned char buffer[16];
+    char midinote = 60;
+    int n = MTS_EncodeNoteTunings(buffer, sizeof(buffer), &midinote, &freq, 1, -1, 0, true);
+    check(n == 12, "message size", freq);
+    for (int i = 0; i < 3; i++)
+        word[i] = buffer[8 + i];
+}
+
+static void checkWord(double freq, int note, int msb, int lsb)
+{
+    unsigned char word[3];
+    encode(freq, word);
+    check(word[0] == note && word[1] == msb && word[2] == lsb, "frequency word", freq);
+}
+
+int main()
+{
+    checkWord(440.0, 69, 0, 0);
+    checkWord(440.0 * pow(2.0, 50.0 / 1200.0), 69, 64, 0);
+
+    // highest note, one step below the reserved 7F 7F 7F
+    checkWord(INFINITY, 127, 127, 126);
+    checkWord(DBL_MAX, 127, 127, 126);
+    checkWord(1.0e300, 127, 127, 126);
+    checkWord(20000.0, 127, 127, 126);
+
+    // lowest note
+    checkWord(NAN, 0, 0, 0);
+    checkWord(-INFINITY, 0, 0, 0);
+    checkWord(-440.0, 0, 0, 0);
+    checkWord(0.0, 0, 0, 0);
+    checkWord(DBL_MIN, 0, 0, 0);
+
+    double freqs[128];
+    for (int i = 0; i < 128; i++)
+        freqs[i] = (i & 1) ? INFINITY : NAN;
+    unsigned char dump[408];
+    check(MTS_EncodeBulkDump(dump, sizeof(dump), freqs, "limits", -1, 0) == 408, "bulk dump size", 0.0);
+    check(dump[22] == 0 && dump[25] == 127 && dump[26] == 127 && dump[27] == 126, "bulk dump words", 0.0);
+
+    double cents[12] = {INFINITY, -INFINITY, NAN, 1.0e300, -1.0e300, 0.0, 50.0, -50.0, 0.0, 0.0, 0.0, 0.0};
+    unsigned char scale[33];
+    check(MTS_EncodeScaleOctave(scale, 21, cents, false, 0xffff, true) == 21, "one byte scale/octave size", 0.0);
+    check(scale[8] == 127 && scale[9] == 0 && scale[10] == 64 && scale[11] == 127 && scale[12] == 0, "one byte scale/octave", 0.0);
+    check(MTS_EncodeScaleOctave(scale, 33, cents, true, 0xffff, true) == 33, "two byte scale/octave size", 0.0);
+    check(scale[8] == 127 && scale[9] == 127 && scale[10] == 0 && scale[11] == 0, "two byte scale/octave, +inf and -inf", 0.0);
+    check(scale[12] == 64 && scale[13] == 0, "two byte scale/octave, NaN", 0.0);
+
+    if (failures == 0)
+        printf("All SysEx encoder checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+/*
+Copyright (C) 2021 by ODDSound Ltd. info@oddsound.com
+
+Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF
+THIS SOFTWARE.
+*/
+
+// Checks, against the stand-in libMTS, that MTS_GetTuningChanges() lists each note retuned since the previous call once
+// with its latest frequency, and asks for every note to be re-queried on the first call, on connecting and disconnecting,
+// after MTS SysEx, on a whole table change and when more notes changed than fit, and that
+// MTS_GetScheduledTuningChanges() lists the changes due within each block, at the nearest sample, only whilst connected
+// and only from the client's own slot. Returns non-zero if any check fails.
+
+#include "libMTSClient.h"
+#include "StandInLibMTS.h"
+#include <stdio.h>
+
+static int failures = 0;
+
+static void check(bool condition, const char *what, int value)
+{
+    if (!condition)
+    {
+        printf("FAILED: %s, got %d\n", what, value);
+        failures++;
+    }
+}
+
+enum {eMaxChanges = 128};
+
+static char notes[eMaxChanges];
+static signed char channels[eMaxChanges];
+static double freqs[eMaxChanges];
+static int offsets[eMaxChanges];
+
+static int changes(MTSClient *client, int maxChanges = eMaxChanges)
+{
+    return MTS_GetTuningChanges(client, notes, channels, freqs, maxChanges);
+}
+
+// Returns true if one of the first numChanges entries is the given change.
+static bool listed(int numChanges, char note, signed char channel, double freq)
+{
+    for (int i = 0; i < numChanges; i++)
+        if (notes[i] == note && channels[i] == channel && freqs[i] == freq)
+            return true;
+    return false;
+}
+
+static void checkChanges(MTSClient *client)
+{
+    int n = changes(client);
+    check(n == -1, "first call", n);
+    n = changes(client);
+    check(n == 0, "no master and no changes", n);
+
+    unsigned char scaleOctave[] = {0xF0, 0x7F, 0x7F, 0x08, 0x08, 0x03, 0x7F, 0x7F, 70, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 0xF7};
+    MTS_ParseMIDIDataU(client, scaleOctave, sizeof(scaleOctave));
+    n = changes(client);
+    check(n == -1, "after MTS SysEx", n);
+    n = changes(client);
+    check(n == 0, "no changes after MTS SysEx", n);
+
+    stub::registerMaster();
+    n = changes(client);
+    check(n == -1, "on connecting", n);
+    n = changes(client);
+    check(n == 0, "no changes since connecting", n);
+
+    stub::setNoteTuning(450.0, 69);
+    stub::setNoteTuning(300.0, 60, 3);
+    n = changes(client);
+    check(n == 2, "two notes retuned", n);
+    check(listed(n, 69, -1, 450.0), "note retuned in the main table", n);
+    check(listed(n, 60, 3, 300.0), "note retuned in a multi-channel table", n);
+    n = changes(client);
+    check(n == 0, "no changes since the previous call", n);
+
+    stub::setNoteTuning(460.0, 69);
+    stub::setNoteTuning(470.0, 69);
+    n = changes(client);
+    check(n == 1 && listed(n, 69, -1, 470.0), "note retuned twice listed once", n);
+
+    stub::setNoteTuning(500.0, 70);
+    stub::setNoteTuning(510.0, 71);
+    stub::setNoteTuning(520.0, 72);
+    n = changes(client, 2);
+    check(n == -1, "more notes retuned than fit", n);
+    n = changes(client);
+    check(n == 0, "no changes after too many", n);
+
+    for (int i = 0; i < stub::eChangeLogSize + 1; i++)
+        stub::setNoteTuning(stub::equalTempered(i), i);
+    n = changes(client);
+    check(n == -1, "more changes than libMTS keeps", n);
+
+    stub::registerMaster();
+    n = changes(client);
+    check(n == -1, "whole table change", n);
+
+    stub::deregisterMaster();
+    n = changes(client);
+    check(n == -1, "on disconnecting", n);
+    n = changes(client);
+    check(n == 0, "no changes since disconnecting", n);
+}
+
+static int scheduled(MTSClient *client, double blockStart, int maxChanges = eMaxChanges)
+{
+    return MTS_GetScheduledTuningChanges(client, blockStart, 64, offsets, notes, channels, freqs, maxChanges);
+}
+
+static void checkSchedule(MTSClient *client)
+{
+    stub::scheduleNoteTuning(500.0, 69, -1, 10.0);
+    int n = scheduled(client, 0.0);
+    check(n == 0, "scheduled changes without a master", n);
+
+    stub::registerMaster();
+    stub::scheduleNoteTuning(500.0, 69, -1, 10.0);
+    stub::scheduleNoteTuning(510.0, 69, -1, 63.5);
+    stub::scheduleNoteTuning(520.0, 60, 2, 64.0);
+    stub::scheduleNoteTuning(530.0, 61, -1, 100.4);
+    stub::scheduleNoteTuning(540.0, 62, -1, 127.6);
+
+    n = scheduled(client, 0.0);
+    check(n == 1 && offsets[0] == 10 && notes[0] == 69 && channels[0] == -1 && freqs[0] == 500.0, "first block", n);
+
+    n = scheduled(client, 64.0);
+    check(n == 3, "second block", n);
+    check(offsets[0] == 0 && notes[0] == 69 && freqs[0] == 510.0, "change half a sample before the block", offsets[0]);
+    check(offsets[1] == 0 && notes[1] == 60 && channels[1] == 2 && freqs[1] == 520.0, "change on a multi-channel table", offsets[1]);
+    check(offsets[2] == 36 && notes[2] == 61 && freqs[2] == 530.0, "change between samples", offsets[2]);
+
+    n = scheduled(client, 128.0);
+    check(n == 1 && offsets[0] == 0 && notes[0] == 62, "change rounded up into the next block", n);
+
+    n = scheduled(client, 64.0, 2);
+    check(n == 2, "more changes than fit", n);
+    n = MTS_GetScheduledTuningChanges(client, 64.0, 64, 0, 0, 0, 0, eMaxChanges);
+    check(n == 3, "without output arrays", n);
+
+    stub::clearScheduledTunings();
+    n = scheduled(client, 64.0);
+    check(n == 0, "cleared", n);
+
+    stub::registerMaster(2);
+    stub::scheduleNoteTuning(550.0, 63, -1, 5.0, 2);
+    n = scheduled(client, 0.0);
+    check(n == 0, "change scheduled in another slot", n);
+    check(MTS_BindClientToSlot(client, 2), "binding to slot 2", 0);
+    n = scheduled(client, 0.0);
+    check(n == 1 && offsets[0] == 5 && notes[0] == 63, "change scheduled in the client's slot", n);
+    check(MTS_BindClientToSlot(client, 0), "binding back to slot 0", 0);
+    stub::deregisterMaster(2);
+
+    stub::scheduleNoteTuning(500.0, 69, -1, 10.0);
+    stub::deregisterMaster();
+    n = scheduled(client, 0.0);
+    check(n == 0, "after disconnecting", n);
+}
+
+int main()
+{
+    check(MTS_Client_SetLibraryLookup(stub::lookup), "installing the stand-in libMTS", 0);
+    MTSClient *client = MTS_RegisterClient();
+
+    checkChanges(client);
+    checkSchedule(client);
+
+    MTS_DeregisterClient(client);
+
+    if (failures == 0)
+        printf("All tuning change checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+/*
+Copyright (C) 2021 by ODDSound Ltd. info@oddsound.com
+
+Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF
+THIS SOFTWARE.
+*/
+
+// Checks, against the stand-in libMTS, that every query format follows the master's tables as they change, that queries
+// and snapshots made whilst the master is part way through a change return the last consistent tuning, that
+// multi-channel tables are used only for channels the master has enabled, and that clients bound to different slots
+// read their own slot's tuning. Returns non-zero if any check fails.
+
+#include "libMTSClient.h"
+#include "StandInLibMTS.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failures = 0;
+
+static void check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static bool within(double a, double b, double tolerance) {return fabs(a - b) <= tolerance;}
+
+// Checks every single-note and batch query of a note against its expected frequency.
+static void checkNote(MTSClient *client, char note, signed char channel, double freq, const char *what)
+{
+    double ratio = freq / stub::equalTempered(note);
+    double semitones = 12.0 * log2(ratio);
+    bool ok = true;
+
+    ok = ok && MTS_NoteToFrequency(client, note, channel) == freq;
+    ok = ok && within(MTS_RetuningAsRatio(client, note, channel), ratio, 1e-12);
+    ok = ok && within(MTS_RetuningInSemitones(client, note, channel), semitones, 1e-12);
+    ok = ok && MTS_NoteToFrequencyFloat(client, note, channel) == static_cast<float>(freq);
+    ok = ok && within(MTS_RetuningAsRatioFloat(client, note, channel), ratio, 1e-6);
+    ok = ok && within(MTS_RetuningInSemitonesFloat(client, note, channel), semitones, 1e-5);
+    ok = ok && abs(MTS_RetuningInCentsQ16(client, note, channel) - static_cast<int>(floor(semitones * 100.0 * 65536.0 + 0.5))) <= 1;
+
+    double freqs[1];
+    double ratios[1];
+    double semitoneValues[1];
+    MTS_NoteToFrequencies(client, &note, &channel, freqs, 1);
+    MTS_RetuningsAsRatios(client, &note, &channel, ratios, 1);
+    MTS_RetuningsInSemitones(client, &note, &channel, semitoneValues, 1);
+    ok = ok && freqs[0] == freq && within(ratios[0], ratio, 1e-12) && within(semitoneValues[0], semitones, 1e-12);
+
+    double snapshot[128];
+    MTS_GetTuningSnapshot(client, snapshot, channel);
+    ok = ok && snapshot[note & 127] == freq;
+
+    if (channel >= 0)
+        ok = ok && MTS_KeyToFrequency(client, (channel << 7) | note) == freq;
+
+    check(ok, what);
+}
+
+static void checkRebuild(MTSClient *client)
+{
+    checkNote(client, 69, -1, 440.0, "equal temperament on connecting");
+
+    stub::setNoteTuning(450.0, 69);
+    checkNote(client, 69, -1, 450.0, "retuned note");
+    checkNote(client, 69, 5, 450.0, "retuned note on a channel without a multi-channel table");
+    checkNote(client, 70, -1, stub::equalTempered(70), "neighbour of a retuned note");
+
+    stub::setNoteTuning(430.0, 69);
+    checkNote(client, 69, -1, 430.0, "note retuned twice");
+}
+
+// A master that stops part way through a change must not leave clients with a mix of old and new frequencies.
+static void checkSeqlock(MTSClient *client)
+{
+    stub::setNoteTuning(stub::equalTempered(60), 60);
+    stub::setNoteTuning(440.0, 69);
+    checkNote(client, 60, -1, stub::equalTempered(60), "before a change");
+    checkNote(client, 69, -1, 440.0, "before a change");
+    unsigned int generation = MTS_GetTuningGeneration(client);
+
+    stub::beginWrite();
+    stub::slots[0].tuning[60] = 250.0;
+    stub::slots[0].tuning[69] = 460.0;
+    checkNote(client, 60, -1, stub::equalTempered(60), "first note whilst the master is writing");
+    checkNote(client, 69, -1, 440.0, "second note whilst the master is writing");
+
+    char notes[2] = {60, 69};
+    double freqs[2];
+    MTS_NoteToFrequencies(client, notes, 0, freqs, 2);
+    check(freqs[0] == stub::equalTempered(60) && freqs[1] == 440.0, "batch query whilst the master is writing");
+
+    stub::endWrite();
+    check(MTS_GetTuningGeneration(client) != generation, "generation after a change");
+    checkNote(client, 60, -1, 250.0, "first note after a change");
+    checkNote(client, 69, -1, 460.0, "second note after a change");
+
+    // A change to a note not yet queried, so the client has no previous table entry to fall back on.
+    stub::beginWrite();
+    stub::slots[0].tuning[100] = 3000.0;
+    double snapshot[128];
+    MTS_GetTuningSnapshot(client, snapshot, -1);
+    check(snapshot[100] == stub::equalTempered(100) && snapshot[60] == 250.0, "snapshot whilst the master is writing");
+    stub::endWrite();
+    MTS_GetTuningSnapshot(client, snapshot, -1);
+    check(snapshot[100] == 3000.0 && snapshot[60] == 250.0, "snapshot after a change");
+
+    stub::registerMaster();
+    checkNote(client, 60, -1, stub::equalTempered(60), "whole table change");
+}
+
+static void checkMultiChannel(MTSClient *client)
+{
+    stub::setNoteTuning(500.0, 69, 3);
+    checkNote(client, 69, 3, 440.0, "multi-channel table not in use");
+
+    stub::setMultiChannel(true, 3);
+    checkNote(client, 69, 3, 500.0, "multi-channel table in use");
+    checkNote(client, 69, 4, 440.0, "channel without a multi-channel table");
+    checkNote(client, 69, -1, 440.0, "no channel with a multi-channel table in use");
+
+    stub::setMultiChannel(false, 3);
+    checkNote(client, 69, 3, 440.0, "multi-channel table no longer in use");
+}
+
+static void checkSlots(MTSClient *client)
+{
+    MTSClient *other = MTS_RegisterClient();
+    unsigned int generation = MTS_GetTuningGeneration(client);
+
+    check(MTS_BindClientToSlot(client, 5), "binding to slot 5");
+    check(MTS_GetTuningGeneration(client) != generation, "generation on binding to another slot");
+    check(!MTS_HasMaster(client), "empty slot has no master");
+    checkNote(client, 69, -1, 440.0, "local tuning in an empty slot");
+
+    stub::registerMaster(5);
+    stub::setNoteTuning(600.0, 60, -1, 5);
+    check(MTS_HasMaster(client), "master in slot 5");
+    checkNote(client, 60, -1, 600.0, "tuning of slot 5");
+    checkNote(other, 60, -1, stub::equalTempered(60), "tuning of slot 0 with a master in slot 5");
+
+    stub::setNoteTuning(300.0, 60);
+    checkNote(client, 60, -1, 600.0, "slot 5 after a change in slot 0");
+    checkNote(other, 60, -1, 300.0, "slot 0 after a change in slot 0");
+
+    check(!MTS_BindClientToSlot(client, stub::eNumSlots), "binding to a slot that does not exist");
+    checkNote(client, 60, -1, 600.0, "tuning after failing to bind");
+
+    stub::deregisterMaster(5);
+    check(!MTS_HasMaster(client), "master in slot 5 deregistered");
+    check(MTS_HasMaster(other), "master in slot 0 after deregistering in slot 5");
+
+    check(MTS_BindClientToSlot(client, 0), "binding back to slot 0");
+    checkNote(client, 60, -1, 300.0, "tuning of slot 0 after binding back");
+
+    MTS_DeregisterClient(other);
+}
+
+int main()
+{
+    check(MTS_Client_SetLibraryLookup(stub::lookup), "installing the stand-in libMTS");
+    MTSClient *client = MTS_RegisterClient();
+
+    checkNote(client, 69, -1, 440.0, "local tuning");
+    stub::registerMaster();
+    check(MTS_HasMaster(client), "connecting");
+
+    checkRebuild(client);
+    checkSeqlock(client);
+    checkMultiChannel(client);
+    checkSlots(client);
+
+    stub::deregisterMaster();
+    check(!MTS_HasMaster(client), "disconnecting");
+    MTS_DeregisterClient(client);
+
+    if (failures == 0)
+        printf("All tuning table checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,1259 @@
+/*
+Copyright (C) 2021 by ODDSound Ltd. info@oddsound.com
+
+Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF
+THIS SOFTWARE.
+*/
+
+/*
+ Reference implementation of the libMTS dynamic library for POSIX systems, exporting every function resolved by
+ libMTSClient.cpp and libMTSMaster.cpp.
+
+ All tuning data lives in a single mtsstate struct. With IPC support enabled (the default, see MTS-ESP.conf) this is
+ placed in POSIX shared memory so that a master and clients in different processes share it, otherwise it is local to
+ the process that loaded the library. The MTS_ESP_CONFIG_PATH environment variable names a config file to read in
+ place of the installed one, e.g. to keep a master and its clients within one process for testing or offline rendering.
+
+ Tables are written only by the master. Clients read them directly through the pointers returned by
+ MTS_GetTuningTable() and MTS_GetMultiChannelTuningTable(), guarded by the sequence lock returned by
+ MTS_GetTuningSequence(), which is odd whilst the master is writing. The multi-channel tables are also returned as one
+ cache-aligned block of 16 x 128 frequencies by MTS_GetMultiChannelTuningTables().
+
+ Non-realtime threads can wait for the master to change anything with MTS_WaitForTuningChange(). On Linux this sleeps on
+ a futex on the generation counter, which works across processes sharing the state, and is woken by the master only if
+ there are waiters. Elsewhere it polls the counter.
+
+ Changes to tuning are also recorded in a bounded ring of change records, each holding the generation in which a note
+ was retuned and its new frequency, so clients can find which notes changed with MTS_GetTuningChanges() instead of
+ re-querying every held note. Records are written only by the master and validated by readers, which never wait.
+
+ Whilst the master has enabled diagnostics, each client claims an entry in the state and counts its queries there, so
+ the master can see which clients, in which processes, are making the most calls. A process holds a lock on the shared
+ memory file for each entry it owns, which the system drops if the process exits, so entries of crashed processes can
+ be reclaimed without relying on process IDs, which differ between PID namespaces, e.g. in sandboxed plug-in hosts.
+
+ Note filters are also kept as bit masks, returned by MTS_GetNoteFilterMasks() and MTS_GetMultiChannelNoteFilterMasks(),
+ so clients can test a note with a single read and copy a channel's whole filter under the sequence lock.
+
+ The master can also schedule retunings for sample positions on the host timeline with MTS_ScheduleNoteTuning(). These
+ are kept in a ring in time order, separate from the tables, from which clients read the changes due within each block.
+
+ The state holds several tuning slots, each an independent copy of everything above except the diagnostics, so that
+ several masters can run at once. Every function taking a slot has an MTS_Slot_ export, and the original exports use
+ slot 0. Clients resolve a slot's tables, sequence, flags and masks once when they bind to it, then read them as before.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#define MTS_EXPORT extern "C" __attribute__((visibility("default")))
+
+const static int libMTSVersion = 0x00010003;
+
+const static char *sharedMemoryName = "/MTS-ESP";
+const static unsigned int stateMagic = 0x4D545345; // 'MTSE'
+const static unsigned int stateVersion = 10;
+
+#ifdef __APPLE__
+const static char *configPath = "/Library/Application Support/MTS-ESP/MTS-ESP.conf";
+#else
+const static char *configPath = "/usr/local/etc/MTS-ESP.conf";
+#endif
+
+// One retuned note, or with midinote -1 a change to every note in a table, e.g. on reset. midichannel is the channel of
+// a multi-channel table, or -1 for the main table. position is written last and invalidated first whilst the record
+// is being overwritten, so a reader can tell whether the rest of the record is the one it expected.
+struct mtschange
+{
+    unsigned int position;
+    unsigned int generation;
+    signed char midichannel;
+    signed char midinote;
+    double freq;
+};
+
+// A retuning scheduled by the master for a sample position on the host timeline. Written and validated by position in
+// the same way as mtschange.
+struct mtsscheduledchange
+{
+    unsigned int position;
+    signed char midichannel;
+    signed char midinote;
+    double time;
+    double freq;
+};
+
+// Counters for one client, written only by that client. The meaning of each counter is defined by libMTSClient.cpp
+// and libMTSMaster.h.
+struct mtsdiagnostics
+{
+    enum {eNumCounters = 16};
+
+    unsigned int inUse; // non-zero whilst claimed, and incremented by every claim so only one process can reclaim an entry
+    int processID;      // as seen by the owning process, for reporting only
+    unsigned long long owner; // token of the owning process, see mtslibglobal::ownerToken
+    unsigned int counters[eNumCounters];
+};
+
+// One tuning slot, with its own master, tables, filters and generation counter.
+struct mtsslot
+{
+    // Read by clients without calling into the library, so only ever written with atomic stores.
+    unsigned int sequence;
+    unsigned int generation;
+    unsigned int hasMaster;
+
+    unsigned long long masterOwner; // token of the registered master's process, see mtslibglobal::ownerToken
+    int updateDepth;
+    int numWaiters;
+
+    double tuning[128];
+    double multiChannelTuning[16][128] __attribute__((aligned(64))); // contiguous, so a flat key (channel << 7) | note indexes every table
+    bool useMultiChannel[16];
+
+    bool noteFilter[128];               // set by MTS_FilterNote() with midichannel -1
+    bool channelNoteFilter[16][128];    // set by MTS_FilterNote() with a MIDI channel
+    bool multiChannelNoteFilter[16][128];
+
+    // The filters above as masks of four 32 bit words, bit (note & 31) of word (note >> 5), read by clients without calling
+    // into the library. Masks 0-15 combine the main filter with each channel's filter, mask 16 with every channel's.
+    unsigned int noteFilterMasks[17][4];
+    unsigned int multiChannelNoteFilterMasks[16][4];
+
+    char scaleName[256];
+    double periodRatio;
+    signed char mapSize;
+    signed char mapStartKey;
+    signed char refKey;
+
+    enum {eChangeLogSize = 1024, eMaxNoteChanges = 64};
+
+    unsigned int changeHead;            // position of the next record, counting every record ever written
+    mtschange changeLog[eChangeLogSize];
+
+    enum {eScheduleSize = 1024};
+
+    unsigned int scheduleHead;          // position of the next scheduled change
+    unsigned int scheduleStart;         // position of the oldest scheduled change that has not been cleared
+    mtsscheduledchange schedule[eScheduleSize];
+
+    // Records a change made by the master, which becomes visible to clients in the next generation.
+    void logChange(signed char midichannel, signed char midinote, double freq)
+    {
+        unsigned int position = changeHead;
+        mtschange &c = changeLog[position & (eChangeLogSize - 1)];
+        __atomic_store_n(&c.position, ~position, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        c.generation = generation + 1;
+        c.midichannel = midichannel;
+        c.midinote = midinote;
+        c.freq = freq;
+        __atomic_store_n(&c.position, position, __ATOMIC_RELEASE);
+        __atomic_store_n(&changeHead, position + 1, __ATOMIC_RELEASE);
+    }
+
+    // Changes are kept in time order, so one scheduled before the last is moved to the same time as the last.
+    void scheduleChange(double time, signed char midichannel, signed char midinote, double freq)
+    {
+        unsigned int position = scheduleHead;
+        if (position != scheduleStart)
+        {
+            double last = schedule[(position - 1) & (eScheduleSize - 1)].time;
+            if (time < last)
+                time = last;
+        }
+
+        mtsscheduledchange &c = schedule[position & (eScheduleSize - 1)];
+        __atomic_store_n(&c.position, ~position, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        c.midichannel = midichannel;
+        c.midinote = midinote;
+        c.time = time;
+        c.freq = freq;
+        __atomic_store_n(&c.position, position, __ATOMIC_RELEASE);
+        __atomic_store_n(&scheduleHead, position + 1, __ATOMIC_RELEASE);
+    }
+
+    void clearSchedule() {__atomic_store_n(&scheduleStart, scheduleHead, __ATOMIC_RELEASE);}
+
+    // Replaces a whole table, recording only the notes that differ, or a single change to the whole table if many do.
+    void setTable(double *table, const double *freqs, signed char midichannel)
+    {
+        int numChanged = 0;
+        for (int i = 0; i < 128; i++)
+            numChanged += table[i] != freqs[i];
+
+        if (numChanged > eMaxNoteChanges)
+            logChange(midichannel, -1, 0.0);
+        else
+            for (int i = 0; i < 128 && numChanged; i++)
+                if (table[i] != freqs[i])
+                    logChange(midichannel, static_cast<signed char>(i), freqs[i]);
+
+        memcpy(table, freqs, 128 * sizeof(double));
+    }
+
+    static unsigned int filterMaskWord(const bool *filter, int word)
+    {
+        unsigned int mask = 0;
+        for (int i = 0; i < 32; i++)
+            mask |= static_cast<unsigned int>(filter[word * 32 + i]) << i;
+        return mask;
+    }
+
+    // Must be called after any change to the filters, whilst still writing.
+    void updateFilterMasks()
+    {
+        for (int w = 0; w < 4; w++)
+        {
+            unsigned int general = filterMaskWord(noteFilter, w);
+            unsigned int anyChannel = general;
+            for (int i = 0; i < 16; i++)
+            {
+                unsigned int channel = general | filterMaskWord(channelNoteFilter[i], w);
+                anyChannel |= channel;
+                __atomic_store_n(&noteFilterMasks[i][w], channel, __ATOMIC_RELAXED);
+                __atomic_store_n(&multiChannelNoteFilterMasks[i][w], filterMaskWord(multiChannelNoteFilter[i], w), __ATOMIC_RELAXED);
+            }
+            __atomic_store_n(&noteFilterMasks[16][w], anyChannel, __ATOMIC_RELAXED);
+        }
+    }
+
+    void resetTuning()
+    {
+        for (int i = 0; i < 128; i++)
+        {
+            tuning[i] = 440.0 * pow(2.0, (i - 69.0) / 12.0);
+            noteFilter[i] = false;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            useMultiChannel[i] = false;
+            for (int j = 0; j < 128; j++)
+            {
+                multiChannelTuning[i][j] = tuning[j];
+                channelNoteFilter[i][j] = false;
+                multiChannelNoteFilter[i][j] = false;
+            }
+        }
+
+        strcpy(scaleName, "12-TET");
+        periodRatio = 2.0;
+        mapSize = -1;
+        mapStartKey = -1;
+        refKey = -1;
+
+        updateFilterMasks();
+        clearSchedule();
+        logChange(-1, -1, 0.0);
+    }
+
+    void reset()
+    {
+        __atomic_store_n(&sequence, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&hasMaster, 0, __ATOMIC_RELAXED);
+        masterOwner = 0;
+        updateDepth = 0;
+        resetTuning();
+        __atomic_add_fetch(&generation, 1, __ATOMIC_SEQ_CST);
+    }
+};
+
+struct mtsstate
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int size;
+
+    int numClients;
+
+    // Slot 0 is the one used by masters and clients that do not choose a slot.
+    enum {eNumSlots = 16};
+
+    mtsslot slots[eNumSlots];
+
+    enum {eMaxDiagnosticsClients = 64};
+
+    // Read by clients without calling into the library. Zero whilst disabled, otherwise a value that changes whenever
+    // diagnostics are enabled or an entry is released, so a client that found no free entry knows when to try again.
+    unsigned int diagnosticsEnabled;
+    unsigned int diagnosticsEpoch;
+    mtsdiagnostics diagnostics[eMaxDiagnosticsClients];
+
+    void reset()
+    {
+        version = stateVersion;
+        size = sizeof(mtsstate);
+        numClients = 0;
+        __atomic_store_n(&diagnosticsEnabled, 0, __ATOMIC_RELAXED); // diagnosticsEpoch is kept, so flag values aren't reused
+        memset(diagnostics, 0, sizeof(diagnostics));
+        for (int i = 0; i < eNumSlots; i++)
+            slots[i].reset();
+    }
+};
+
+static inline bool validChannel(signed char midichannel) {return !(midichannel & ~15);}
+
+struct mtslibglobal
+{
+    mtslibglobal()
+    : state(&localState)
+    , ipc(false)
+    , lockFD(-1)
+    , ownerToken(newOwnerToken())
+    {
+        memset(&localState, 0, sizeof(localState));
+        localState.reset();
+        localState.magic = stateMagic;
+
+        if (ipcEnabled())
+            ipc = openSharedState();
+    }
+
+    ~mtslibglobal()
+    {
+        if (ipc)
+            munmap(state, sizeof(mtsstate));
+        if (lockFD >= 0)
+            close(lockFD);
+    }
+
+    // Reads ipc_support from the config file, defaulting to enabled if the file or setting is missing.
+    static bool ipcEnabled()
+    {
+        const char *path = getenv("MTS_ESP_CONFIG_PATH");
+        FILE *f = fopen(path && *path ? path : configPath, "r");
+        if (!f)
+            return true;
+
+        bool enabled = true;
+        char line[256];
+        while (fgets(line, sizeof(line), f))
+        {
+            int value = 0;
+            if (line[0] != '#' && sscanf(line, " ipc_support = %d", &value) == 1)
+                enabled = value != 0;
+        }
+
+        fclose(f);
+        return enabled;
+    }
+
+    // Maps the shared state, creating and initializing it if this is the first process to load the library.
+    // Falls back to process-local state if shared memory is unavailable or was created by an incompatible library.
+    bool openSharedState()
+    {
+        bool created = true;
+        int fd = shm_open(sharedMemoryName, O_RDWR | O_CREAT | O_EXCL, 0666);
+        if (fd < 0)
+        {
+            created = false;
+            fd = shm_open(sharedMemoryName, O_RDWR, 0666);
+        }
+
+        if (fd < 0)
+            return false;
+
+        if (created)
+        {
+            fchmod(fd, 0666); // not restricted by the creating process's umask, so any user's plug-ins can connect
+            if (ftruncate(fd, sizeof(mtsstate)) != 0)
+            {
+                close(fd);
+                shm_unlink(sharedMemoryName);
+                return false;
+            }
+        }
+        else if (!waitForSize(fd))
+        {
+            close(fd);
+            return false;
+        }
+
+        void *p = mmap(0, sizeof(mtsstate), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (p == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+
+        mtsstate *shared = static_cast<mtsstate*>(p);
+
+        if (created)
+        {
+            shared->reset();
+            __atomic_store_n(&shared->magic, stateMagic, __ATOMIC_RELEASE);
+        }
+        else if (!waitForMagic(shared) || shared->version != stateVersion || shared->size != sizeof(mtsstate))
+        {
+            munmap(p, sizeof(mtsstate));
+            close(fd);
+            return false;
+        }
+
+        state = shared;
+        lockFD = fd; // kept open, as closing any descriptor for the file drops this process's locks on it
+        return true;
+    }
+
+    // Another process may have created the shared memory but not yet sized or initialized it.
+    enum {eMaxWaitMs = 1000};
+
+    static bool waitForSize(int fd)
+    {
+        struct stat st;
+        for (int i = 0; i < eMaxWaitMs; i++)
+        {
+            if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(mtsstate)))
+                return true;
+            usleep(1000);
+        }
+        return false;
+    }
+
+    static bool waitForMagic(mtsstate *shared)
+    {
+        for (int i = 0; i < eMaxWaitMs; i++)
+        {
+            if (__atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) == stateMagic)
+                return true;
+            usleep(1000);
+        }
+        return false;
+    }
+
+    // Every change made by the master is wrapped in beginWrite()/endWrite(). The sequence is odd in between, and the
+    // generation is incremented once the outermost change is complete.
+    static inline void beginWrite(mtsslot &slot)
+    {
+        if (slot.updateDepth++ == 0)
+        {
+            __atomic_add_fetch(&slot.sequence, 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+        }
+    }
+
+    static inline void endWrite(mtsslot &slot)
+    {
+        if (slot.updateDepth > 0 && --slot.updateDepth == 0)
+        {
+            __atomic_add_fetch(&slot.sequence, 1, __ATOMIC_RELEASE);
+            __atomic_add_fetch(&slot.generation, 1, __ATOMIC_SEQ_CST);
+            wakeWaiters(slot);
+        }
+    }
+
+    // Abandons any change left open in a slot, so a master that crashed or never committed an update does not leave the
+    // sequence odd, which would make clients wait for a change that never completes. Only called when a master registers
+    // or deregisters, when no other change can be in progress in the slot.
+    static inline void abandonWrite(mtsslot &slot)
+    {
+        slot.updateDepth = 0;
+        if (__atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) & 1)
+            __atomic_add_fetch(&slot.sequence, 1, __ATOMIC_RELEASE);
+    }
+
+    // The generation is incremented before numWaiters is read and waiters increment numWaiters before reading the
+    // generation, both sequentially consistent, so a waiter either sees the new generation or is woken.
+    static inline void wakeWaiters(mtsslot &slot)
+    {
+#ifdef __linux__
+        if (__atomic_load_n(&slot.numWaiters, __ATOMIC_SEQ_CST) > 0)
+            syscall(SYS_futex, &slot.generation, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+#endif
+    }
+
+    static long long nowMs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<long long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    static unsigned int waitForChange(mtsslot &slot, unsigned int lastGeneration, int timeoutMs)
+    {
+        unsigned int *g = &slot.generation;
+        unsigned int current = __atomic_load_n(g, __ATOMIC_SEQ_CST);
+        if (current != lastGeneration || timeoutMs <= 0)
+            return current;
+
+        long long deadline = nowMs() + timeoutMs;
+        __atomic_add_fetch(&slot.numWaiters, 1, __ATOMIC_SEQ_CST);
+
+        while ((current = __atomic_load_n(g, __ATOMIC_SEQ_CST)) == lastGeneration)
+        {
+            long long remaining = deadline - nowMs();
+            if (remaining <= 0)
+                break;
+#ifdef __linux__
+            struct timespec ts;
+            ts.tv_sec = static_cast<time_t>(remaining / 1000);
+            ts.tv_nsec = static_cast<long>((remaining % 1000) * 1000000);
+            syscall(SYS_futex, g, FUTEX_WAIT, lastGeneration, &ts, 0, 0);
+#else
+            usleep(1000);
+#endif
+        }
+
+        __atomic_sub_fetch(&slot.numWaiters, 1, __ATOMIC_SEQ_CST);
+        return current;
+    }
+
+    // Collects the latest frequency of each note retuned after sinceGeneration, newest first, scanning back through the
+    // change log until a record from sinceGeneration or earlier is found. Returns -1 if every note must be treated as
+    // changed: the records are no longer in the log, a whole table changed, or there are more than maxChanges.
+    static int readChanges(mtsslot &slot, unsigned int sinceGeneration, unsigned int *currentGeneration, char *midinotes, signed char *midichannels, double *freqs, int maxChanges)
+    {
+        unsigned int committed = __atomic_load_n(&slot.generation, __ATOMIC_ACQUIRE);
+        if (currentGeneration)
+            *currentGeneration = committed;
+
+        unsigned int head = __atomic_load_n(&slot.changeHead, __ATOMIC_ACQUIRE);
+        unsigned char seen[17][16]; // bit per note for each multi-channel table and the main table
+        memset(seen, 0, sizeof(seen));
+        int numChanges = 0;
+
+        for (int i = 1; i <= mtsslot::eChangeLogSize; i++)
+        {
+            unsigned int position = head - i;
+            const mtschange &c = slot.changeLog[position & (mtsslot::eChangeLogSize - 1)];
+            if (__atomic_load_n(&c.position, __ATOMIC_ACQUIRE) != position)
+                return -1;
+
+            unsigned int generation = c.generation;
+            signed char midichannel = c.midichannel;
+            signed char midinote = c.midinote;
+            double freq = c.freq;
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&c.position, __ATOMIC_RELAXED) != position)
+                return -1;
+
+            if (static_cast<int>(generation - sinceGeneration) <= 0)
+                return numChanges;
+            if (static_cast<int>(generation - committed) > 0) // written by an update that has not finished
+                continue;
+            if (midinote < 0)
+                return -1;
+
+            int table = validChannel(midichannel) ? midichannel : 16;
+            unsigned char bit = static_cast<unsigned char>(1 << (midinote & 7));
+            if (seen[table][midinote >> 3] & bit)
+                continue;
+            seen[table][midinote >> 3] |= bit;
+
+            if (numChanges == maxChanges)
+                return -1;
+            if (midinotes)
+                midinotes[numChanges] = static_cast<char>(midinote);
+            if (midichannels)
+                midichannels[numChanges] = validChannel(midichannel) ? midichannel : static_cast<signed char>(-1);
+            if (freqs)
+                freqs[numChanges] = freq;
+            numChanges++;
+        }
+
+        return -1;
+    }
+
+    // Reads a scheduled change, returning false if the master is overwriting it.
+    static bool readScheduledChange(const mtsslot &slot, unsigned int position, mtsscheduledchange &change)
+    {
+        const mtsscheduledchange &c = slot.schedule[position & (mtsslot::eScheduleSize - 1)];
+        if (__atomic_load_n(&c.position, __ATOMIC_ACQUIRE) != position)
+            return false;
+
+        change.midichannel = c.midichannel;
+        change.midinote = c.midinote;
+        change.time = c.time;
+        change.freq = c.freq;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return __atomic_load_n(&c.position, __ATOMIC_RELAXED) == position;
+    }
+
+    // Collects the changes due within the block of blockLength samples from blockStart, in time order, with each time given
+    // as an offset into the block. A change scheduled between samples is due at the nearest sample, halves rounding up, so
+    // belongs to the block holding that sample, i.e. times within [blockStart - 0.5, blockStart + blockLength - 0.5).
+    // Scans back from the newest change to find the first in the block, then reads forwards.
+    static int readSchedule(const mtsslot &slot, double blockStart, int blockLength, int *offsets, char *midinotes, signed char *midichannels, double *freqs, int maxChanges)
+    {
+        if (blockLength <= 0 || maxChanges <= 0)
+            return 0;
+
+        unsigned int head = __atomic_load_n(&slot.scheduleHead, __ATOMIC_ACQUIRE);
+        unsigned int start = __atomic_load_n(&slot.scheduleStart, __ATOMIC_ACQUIRE);
+        if (head - start > mtsslot::eScheduleSize)
+            start = head - mtsslot::eScheduleSize;
+
+        double firstTime = blockStart - 0.5;
+        double endTime = blockStart + blockLength - 0.5;
+        mtsscheduledchange change;
+        unsigned int first = head;
+        while (first != start && readScheduledChange(slot, first - 1, change) && change.time >= firstTime)
+            first--;
+
+        int numChanges = 0;
+        for (unsigned int position = first; position != head && numChanges < maxChanges; position++)
+        {
+            if (!readScheduledChange(slot, position, change) || change.time >= endTime)
+                break;
+            if (offsets)
+            {
+                int offset = static_cast<int>(floor(change.time - firstTime));
+                offsets[numChanges] = offset < 0 ? 0 : (offset < blockLength ? offset : blockLength - 1);
+            }
+            if (midinotes)
+                midinotes[numChanges] = static_cast<char>(change.midinote);
+            if (midichannels)
+                midichannels[numChanges] = change.midichannel;
+            if (freqs)
+                freqs[numChanges] = change.freq;
+            numChanges++;
+        }
+        return numChanges;
+    }
+
+    // Identifies this process's diagnostics entries. Process IDs can't, as a process in another PID namespace may have the
+    // same one.
+    static unsigned long long newOwnerToken()
+    {
+        unsigned long long token = 0;
+        int fd = open("/dev/urandom", O_RDONLY);
+        if (fd >= 0)
+        {
+            if (read(fd, &token, sizeof(token)) != static_cast<ssize_t>(sizeof(token)))
+                token = 0;
+            close(fd);
+        }
+
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        token ^= (static_cast<unsigned long long>(getpid()) << 32) ^ (static_cast<unsigned long long>(ts.tv_sec) * 1000000000ull + ts.tv_nsec);
+        return token ? token : 1;
+    }
+
+    // Each process holds a write lock on byte i of the shared memory file whilst it owns diagnostics entry i. The locks
+    // are advisory, so don't affect the mapping, and are dropped by the system when the process exits.
+    static struct flock entryLock(int i, short type)
+    {
+        struct flock fl;
+        memset(&fl, 0, sizeof(fl));
+        fl.l_type = type;
+        fl.l_whence = SEEK_SET;
+        fl.l_start = i;
+        fl.l_len = 1;
+        return fl;
+    }
+
+    // Returns false only if another process holds the lock.
+    bool lockEntry(int i)
+    {
+        if (lockFD < 0)
+            return true;
+        struct flock fl = entryLock(i, F_WRLCK);
+        return fcntl(lockFD, F_SETLK, &fl) == 0 || (errno != EACCES && errno != EAGAIN);
+    }
+
+    void unlockEntry(int i)
+    {
+        if (lockFD < 0)
+            return;
+        struct flock fl = entryLock(i, F_UNLCK);
+        fcntl(lockFD, F_SETLK, &fl);
+    }
+
+    // Whether the process owning a claimed entry is still running. An entry whose process has exited without releasing it,
+    // e.g. after a crash, may be claimed again. Where the file can't be locked, falls back to looking for the process ID.
+    bool ownerAlive(int i, const mtsdiagnostics &d)
+    {
+        if (__atomic_load_n(&d.owner, __ATOMIC_RELAXED) == ownerToken || lockFD < 0)
+            return true;
+        struct flock fl = entryLock(i, F_WRLCK);
+        if (fcntl(lockFD, F_GETLK, &fl) == 0)
+            return fl.l_type != F_UNLCK;
+        return kill(d.processID, 0) == 0 || errno != ESRCH;
+    }
+
+    unsigned int nextDiagnosticsEpoch()
+    {
+        unsigned int epoch = __atomic_add_fetch(&state->diagnosticsEpoch, 1, __ATOMIC_RELAXED);
+        return epoch ? epoch : __atomic_add_fetch(&state->diagnosticsEpoch, 1, __ATOMIC_RELAXED);
+    }
+
+    // The lock is taken before the entry is claimed, so two processes can't both reclaim an entry whose owner has exited.
+    unsigned int *acquireDiagnostics()
+    {
+        for (int i = 0; i < mtsstate::eMaxDiagnosticsClients; i++)
+        {
+            mtsdiagnostics &d = state->diagnostics[i];
+            unsigned int inUse = __atomic_load_n(&d.inUse, __ATOMIC_ACQUIRE);
+            if (inUse && ownerAlive(i, d))
+                continue;
+            if (!lockEntry(i))
+                continue;
+            if (!__atomic_compare_exchange_n(&d.inUse, &inUse, inUse + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            {
+                if (__atomic_load_n(&d.owner, __ATOMIC_RELAXED) != ownerToken)
+                    unlockEntry(i);
+                continue;
+            }
+            __atomic_store_n(&d.owner, ownerToken, __ATOMIC_RELAXED);
+            d.processID = getpid();
+            memset(d.counters, 0, sizeof(d.counters));
+            return d.counters;
+        }
+        return 0;
+    }
+
+    // Changes the published flag whilst diagnostics are enabled, so clients that found no free entry try again.
+    void releaseDiagnostics(unsigned int *counters)
+    {
+        for (int i = 0; i < mtsstate::eMaxDiagnosticsClients; i++)
+        {
+            mtsdiagnostics &d = state->diagnostics[i];
+            if (d.counters == counters)
+            {
+                d.processID = 0;
+                __atomic_store_n(&d.owner, 0ull, __ATOMIC_RELAXED);
+                __atomic_store_n(&d.inUse, 0, __ATOMIC_RELEASE);
+                unlockEntry(i);
+            }
+        }
+
+        unsigned int flag = __atomic_load_n(&state->diagnosticsEnabled, __ATOMIC_RELAXED);
+        while (flag && !__atomic_compare_exchange_n(&state->diagnosticsEnabled, &flag, nextDiagnosticsEpoch(), false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        {
+        }
+    }
+
+    // Counters are reset whenever diagnostics are enabled, so the master sees counts from that point on.
+    void setDiagnosticsEnabled(bool enabled)
+    {
+        if (enabled && !__atomic_load_n(&state->diagnosticsEnabled, __ATOMIC_RELAXED))
+            for (int i = 0; i < mtsstate::eMaxDiagnosticsClients; i++)
+                for (int j = 0; j < mtsdiagnostics::eNumCounters; j++)
+                    __atomic_store_n(&state->diagnostics[i].counters[j], 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&state->diagnosticsEnabled, enabled ? nextDiagnosticsEpoch() : 0, __ATOMIC_RELEASE);
+    }
+
+    int readDiagnostics(int *processIDs, unsigned int *counters, int numCounters, int maxClients)
+    {
+        if (numCounters > mtsdiagnostics::eNumCounters)
+            numCounters = mtsdiagnostics::eNumCounters;
+
+        int numClients = 0;
+        for (int i = 0; i < mtsstate::eMaxDiagnosticsClients && numClients < maxClients; i++)
+        {
+            const mtsdiagnostics &d = state->diagnostics[i];
+            if (!__atomic_load_n(&d.inUse, __ATOMIC_ACQUIRE) || !ownerAlive(i, d))
+                continue;
+            if (processIDs)
+                processIDs[numClients] = d.processID;
+            if (counters)
+                for (int j = 0; j < numCounters; j++)
+                    counters[numClients * numCounters + j] = __atomic_load_n(&d.counters[j], __ATOMIC_RELAXED);
+            numClients++;
+        }
+        return numClients;
+    }
+
+    // Returns 0 for a slot that does not exist.
+    mtsslot *slot(int index) {return index >= 0 && index < mtsstate::eNumSlots ? &state->slots[index] : 0;}
+
+    mtsstate localState;
+    mtsstate *state;
+    bool ipc;
+    int lockFD; // the shared memory file, or -1 without IPC
+    unsigned long long ownerToken;
+};
+
+static mtslibglobal global;
+
+static inline bool testFilterMask(const unsigned int *mask, int note)
+{
+    return (__atomic_load_n(&mask[note >> 5], __ATOMIC_RELAXED) >> (note & 31)) & 1;
+}
+
+// master, in a slot
+// A slot has one master at a time: the first to register claims it, and registering in a claimed slot does nothing.
+MTS_EXPORT void MTS_Slot_RegisterMaster(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s)
+        return;
+    unsigned int hasMaster = 0;
+    if (!__atomic_compare_exchange_n(&s->hasMaster, &hasMaster, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return;
+    s->masterOwner = global.ownerToken;
+    global.abandonWrite(*s);
+    global.beginWrite(*s);
+    s->resetTuning();
+    global.endWrite(*s);
+}
+
+// Only a process that registered the slot's master can deregister it, so a master that found the slot claimed can't
+// free it. MTS_Reinitialize() frees every slot, e.g. after a master crashed.
+MTS_EXPORT void MTS_Slot_DeregisterMaster(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s || !__atomic_load_n(&s->hasMaster, __ATOMIC_ACQUIRE) || s->masterOwner != global.ownerToken)
+        return;
+    global.abandonWrite(*s);
+    global.beginWrite(*s);
+    s->resetTuning();
+    __atomic_store_n(&s->hasMaster, 0, __ATOMIC_RELEASE);
+    global.endWrite(*s);
+}
+
+MTS_EXPORT bool MTS_Slot_HasMaster(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? __atomic_load_n(&s->hasMaster, __ATOMIC_ACQUIRE) != 0 : false;
+}
+
+MTS_EXPORT void MTS_Slot_BeginUpdate(int slot)
+{
+    if (mtsslot *s = global.slot(slot))
+        global.beginWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_CommitUpdate(int slot)
+{
+    if (mtsslot *s = global.slot(slot))
+        global.endWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_SetNoteTunings(int slot, const double *freqs)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s || !freqs)
+        return;
+    global.beginWrite(*s);
+    s->setTable(s->tuning, freqs, -1);
+    global.endWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_SetNoteTuning(int slot, double freq, char midinote)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s)
+        return;
+    global.beginWrite(*s);
+    s->tuning[midinote & 127] = freq;
+    s->logChange(-1, static_cast<signed char>(midinote & 127), freq);
+    global.endWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_SetScaleName(int slot, const char *name)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s)
+        return;
+    global.beginWrite(*s);
+    strncpy(s->scaleName, name ? name : "", sizeof(s->scaleName) - 1);
+    s->scaleName[sizeof(s->scaleName) - 1] = '\0';
+    global.endWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_SetPeriodRatio(int slot, double periodRatio)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s)
+        return;
+    global.beginWrite(*s);
+    s->periodRatio = periodRatio;
+    global.endWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_SetMapSize(int slot, signed char size)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s)
+        return;
+    global.beginWrite(*s);
+    s->mapSize = size;
+    global.endWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_SetMapStartKey(int slot, signed char key)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s)
+        return;
+    global.beginWrite(*s);
+    s->mapStartKey = key;
+    global.endWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_SetRefKey(int slot, signed char key)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s)
+        return;
+    global.beginWrite(*s);
+    s->refKey = key;
+    global.endWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_FilterNote(int slot, bool doFilter, char midinote, signed char midichannel)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s)
+        return;
+    global.beginWrite(*s);
+    if (validChannel(midichannel))
+        s->channelNoteFilter[midichannel][midinote & 127] = doFilter;
+    else
+        s->noteFilter[midinote & 127] = doFilter;
+    s->updateFilterMasks();
+    global.endWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_ClearNoteFilter(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s)
+        return;
+    global.beginWrite(*s);
+    memset(s->noteFilter, 0, sizeof(s->noteFilter));
+    memset(s->channelNoteFilter, 0, sizeof(s->channelNoteFilter));
+    s->updateFilterMasks();
+    global.endWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_SetMultiChannel(int slot, bool set, signed char midichannel)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s || !validChannel(midichannel))
+        return;
+    global.beginWrite(*s);
+    if (s->useMultiChannel[midichannel] != set)
+        s->logChange(midichannel, -1, 0.0);
+    s->useMultiChannel[midichannel] = set;
+    global.endWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_SetMultiChannelNoteTunings(int slot, const double *freqs, signed char midichannel)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s || !freqs || !validChannel(midichannel))
+        return;
+    global.beginWrite(*s);
+    s->setTable(s->multiChannelTuning[midichannel], freqs, midichannel);
+    global.endWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_SetMultiChannelNoteTuning(int slot, double freq, char midinote, signed char midichannel)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s || !validChannel(midichannel))
+        return;
+    global.beginWrite(*s);
+    s->multiChannelTuning[midichannel][midinote & 127] = freq;
+    s->logChange(midichannel, static_cast<signed char>(midinote & 127), freq);
+    global.endWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_FilterNoteMultiChannel(int slot, bool doFilter, char midinote, signed char midichannel)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s || !validChannel(midichannel))
+        return;
+    global.beginWrite(*s);
+    s->multiChannelNoteFilter[midichannel][midinote & 127] = doFilter;
+    s->updateFilterMasks();
+    global.endWrite(*s);
+}
+
+MTS_EXPORT void MTS_Slot_ClearNoteFilterMultiChannel(int slot, signed char midichannel)
+{
+    mtsslot *s = global.slot(slot);
+    if (!s || !validChannel(midichannel))
+        return;
+    global.beginWrite(*s);
+    memset(s->multiChannelNoteFilter[midichannel], 0, sizeof(s->multiChannelNoteFilter[midichannel]));
+    s->updateFilterMasks();
+    global.endWrite(*s);
+}
+
+// Schedules are written without the sequence lock, as they do not change the tables.
+MTS_EXPORT void MTS_Slot_ScheduleNoteTuning(int slot, double freq, char midinote, signed char midichannel, double sampleTime)
+{
+    if (mtsslot *s = global.slot(slot))
+        s->scheduleChange(sampleTime, validChannel(midichannel) ? midichannel : static_cast<signed char>(-1), static_cast<signed char>(midinote & 127), freq);
+}
+
+MTS_EXPORT void MTS_Slot_ClearScheduledTunings(int slot)
+{
+    if (mtsslot *s = global.slot(slot))
+        s->clearSchedule();
+}
+
+// client, in a slot. Pointers are 0 for a slot that does not exist, so clients can tell whether they can bind to it.
+MTS_EXPORT const double *MTS_Slot_GetTuningTable(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? s->tuning : 0;
+}
+
+// Always returns the channel's own table, even if the channel is not in use.
+MTS_EXPORT const double *MTS_Slot_GetMultiChannelTuningTable(int slot, signed char midichannel)
+{
+    mtsslot *s = global.slot(slot);
+    return s && validChannel(midichannel) ? s->multiChannelTuning[midichannel] : 0;
+}
+
+MTS_EXPORT const double *MTS_Slot_GetMultiChannelTuningTables(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? s->multiChannelTuning[0] : 0;
+}
+
+MTS_EXPORT bool MTS_Slot_UseMultiChannelTuning(int slot, signed char midichannel)
+{
+    mtsslot *s = global.slot(slot);
+    return s && validChannel(midichannel) ? s->useMultiChannel[midichannel] : false;
+}
+
+MTS_EXPORT const char *MTS_Slot_GetScaleName(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? s->scaleName : "";
+}
+
+MTS_EXPORT double MTS_Slot_GetPeriodRatio(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? s->periodRatio : 2.0;
+}
+
+MTS_EXPORT signed char MTS_Slot_GetMapSize(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? s->mapSize : -1;
+}
+
+MTS_EXPORT signed char MTS_Slot_GetMapStartKey(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? s->mapStartKey : -1;
+}
+
+MTS_EXPORT signed char MTS_Slot_GetRefKey(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? s->refKey : -1;
+}
+
+MTS_EXPORT unsigned int MTS_Slot_GetTuningGeneration(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? __atomic_load_n(&s->generation, __ATOMIC_ACQUIRE) : 0;
+}
+
+MTS_EXPORT const volatile unsigned int *MTS_Slot_GetTuningSequence(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? &s->sequence : 0;
+}
+
+MTS_EXPORT const volatile unsigned int *MTS_Slot_GetHasMasterFlag(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? &s->hasMaster : 0;
+}
+
+MTS_EXPORT const volatile unsigned int *MTS_Slot_GetNoteFilterMasks(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? s->noteFilterMasks[0] : 0;
+}
+
+MTS_EXPORT const volatile unsigned int *MTS_Slot_GetMultiChannelNoteFilterMasks(int slot)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? s->multiChannelNoteFilterMasks[0] : 0;
+}
+
+MTS_EXPORT unsigned int MTS_Slot_WaitForTuningChange(int slot, unsigned int lastGeneration, int timeoutMs)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? global.waitForChange(*s, lastGeneration, timeoutMs) : lastGeneration;
+}
+
+MTS_EXPORT int MTS_Slot_GetTuningChanges(int slot, unsigned int sinceGeneration, unsigned int *currentGeneration, char *midinotes, signed char *midichannels, double *freqs, int maxChanges)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? global.readChanges(*s, sinceGeneration, currentGeneration, midinotes, midichannels, freqs, maxChanges) : -1;
+}
+
+MTS_EXPORT int MTS_Slot_GetScheduledTuningChanges(int slot, double blockStart, int blockLength, int *offsets, char *midinotes, signed char *midichannels, double *freqs, int maxChanges)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? global.readSchedule(*s, blockStart, blockLength, offsets, midinotes, midichannels, freqs, maxChanges) : 0;
+}
+
+MTS_EXPORT bool MTS_Slot_ShouldFilterNote(int slot, char midinote, signed char midichannel)
+{
+    mtsslot *s = global.slot(slot);
+    return s ? testFilterMask(s->noteFilterMasks[validChannel(midichannel) ? midichannel : 16], midinote & 127) : false;
+}
+
+MTS_EXPORT bool MTS_Slot_ShouldFilterNoteMultiChannel(int slot, char midinote, signed char midichannel)
+{
+    mtsslot *s = global.slot(slot);
+    return s && validChannel(midichannel) ? testFilterMask(s->multiChannelNoteFilterMasks[midichannel], midinote & 127) : false;
+}
+
+// master, in slot 0
+MTS_EXPORT void MTS_RegisterMaster(void *)          {MTS_Slot_RegisterMaster(0);}
+MTS_EXPORT void MTS_DeregisterMaster()              {MTS_Slot_DeregisterMaster(0);}
+MTS_EXPORT bool MTS_HasIPC()                        {return global.ipc;}
+MTS_EXPORT int MTS_GetNumClients()                  {return __atomic_load_n(&global.state->numClients, __ATOMIC_RELAXED);}
+MTS_EXPORT void MTS_BeginUpdate()                   {MTS_Slot_BeginUpdate(0);}
+MTS_EXPORT void MTS_CommitUpdate()                  {MTS_Slot_CommitUpdate(0);}
+MTS_EXPORT void MTS_SetNoteTunings(const double *freqs) {MTS_Slot_SetNoteTunings(0, freqs);}
+MTS_EXPORT void MTS_SetNoteTuning(double freq, char midinote) {MTS_Slot_SetNoteTuning(0, freq, midinote);}
+MTS_EXPORT void MTS_SetScaleName(const char *name)  {MTS_Slot_SetScaleName(0, name);}
+MTS_EXPORT void MTS_SetPeriodRatio(double periodRatio) {MTS_Slot_SetPeriodRatio(0, periodRatio);}
+MTS_EXPORT void MTS_SetMapSize(signed char size)    {MTS_Slot_SetMapSize(0, size);}
+MTS_EXPORT void MTS_SetMapStartKey(signed char key) {MTS_Slot_SetMapStartKey(0, key);}
+MTS_EXPORT void MTS_SetRefKey(signed char key)      {MTS_Slot_SetRefKey(0, key);}
+MTS_EXPORT void MTS_ClearNoteFilter()               {MTS_Slot_ClearNoteFilter(0);}
+MTS_EXPORT void MTS_ClearScheduledTunings()         {MTS_Slot_ClearScheduledTunings(0);}
+MTS_EXPORT void MTS_SetDiagnosticsEnabled(bool enabled) {global.setDiagnosticsEnabled(enabled);}
+
+// Resets every slot.
+MTS_EXPORT void MTS_Reinitialize()
+{
+    global.state->reset();
+    for (int i = 0; i < mtsstate::eNumSlots; i++)
+        global.wakeWaiters(global.state->slots[i]);
+}
+
+// Copies numCounters counters for each client with diagnostics into counters, one client after another, returning the
+// number of clients.
+MTS_EXPORT int MTS_GetDiagnostics(int *processIDs, unsigned int *counters, int numCounters, int maxClients)
+{
+    return global.readDiagnostics(processIDs, counters, numCounters, maxClients);
+}
+
+MTS_EXPORT void MTS_FilterNote(bool doFilter, char midinote, signed char midichannel)
+{
+    MTS_Slot_FilterNote(0, doFilter, midinote, midichannel);
+}
+
+MTS_EXPORT void MTS_SetMultiChannel(bool set, signed char midichannel)
+{
+    MTS_Slot_SetMultiChannel(0, set, midichannel);
+}
+
+MTS_EXPORT void MTS_SetMultiChannelNoteTunings(const double *freqs, signed char midichannel)
+{
+    MTS_Slot_SetMultiChannelNoteTunings(0, freqs, midichannel);
+}
+
+MTS_EXPORT void MTS_SetMultiChannelNoteTuning(double freq, char midinote, signed char midichannel)
+{
+    MTS_Slot_SetMultiChannelNoteTuning(0, freq, midinote, midichannel);
+}
+
+MTS_EXPORT void MTS_FilterNoteMultiChannel(bool doFilter, char midinote, signed char midichannel)
+{
+    MTS_Slot_FilterNoteMultiChannel(0, doFilter, midinote, midichannel);
+}
+
+MTS_EXPORT void MTS_ClearNoteFilterMultiChannel(signed char midichannel)
+{
+    MTS_Slot_ClearNoteFilterMultiChannel(0, midichannel);
+}
+
+MTS_EXPORT void MTS_ScheduleNoteTuning(double freq, char midinote, signed char midichannel, double sampleTime)
+{
+    MTS_Slot_ScheduleNoteTuning(0, freq, midinote, midichannel, sampleTime);
+}
+
+// client, in slot 0
+MTS_EXPORT void MTS_RegisterClient()                {__atomic_add_fetch(&global.state->numClients, 1, __ATOMIC_RELAXED);}
+MTS_EXPORT void MTS_DeregisterClient()              {__atomic_sub_fetch(&global.state->numClients, 1, __ATOMIC_RELAXED);}
+MTS_EXPORT int MTS_GetVersionNumber()               {return libMTSVersion;}
+MTS_EXPORT bool MTS_HasMaster()                     {return MTS_Slot_HasMaster(0);}
+MTS_EXPORT const double *MTS_GetTuningTable()       {return MTS_Slot_GetTuningTable(0);}
+MTS_EXPORT const char *MTS_GetScaleName()           {return MTS_Slot_GetScaleName(0);}
+MTS_EXPORT double MTS_GetPeriodRatio()              {return MTS_Slot_GetPeriodRatio(0);}
+MTS_EXPORT signed char MTS_GetMapSize()             {return MTS_Slot_GetMapSize(0);}
+MTS_EXPORT signed char MTS_GetMapStartKey()         {return MTS_Slot_GetMapStartKey(0);}
+MTS_EXPORT signed char MTS_GetRefKey()              {return MTS_Slot_GetRefKey(0);}
+MTS_EXPORT unsigned int MTS_GetTuningGeneration()   {return MTS_Slot_GetTuningGeneration(0);}
+MTS_EXPORT const volatile unsigned int *MTS_GetTuningSequence() {return MTS_Slot_GetTuningSequence(0);}
+MTS_EXPORT const volatile unsigned int *MTS_GetHasMasterFlag()  {return MTS_Slot_GetHasMasterFlag(0);}
+MTS_EXPORT const volatile unsigned int *MTS_GetDiagnosticsFlag() {return &global.state->diagnosticsEnabled;}
+MTS_EXPORT const volatile unsigned int *MTS_GetNoteFilterMasks() {return MTS_Slot_GetNoteFilterMasks(0);}
+MTS_EXPORT const volatile unsigned int *MTS_GetMultiChannelNoteFilterMasks() {return MTS_Slot_GetMultiChannelNoteFilterMasks(0);}
+MTS_EXPORT unsigned int *MTS_AcquireDiagnostics()   {return global.acquireDiagnostics();}
+MTS_EXPORT void MTS_ReleaseDiagnostics(unsigned int *counters) {global.releaseDiagnostics(counters);}
+
+// Blocks until the generation differs from lastGeneration or the timeout expires, returning the current generation.
+MTS_EXPORT unsigned int MTS_WaitForTuningChange(unsigned int lastGeneration, int timeoutMs)
+{
+    return MTS_Slot_WaitForTuningChange(0, lastGeneration, timeoutMs);
+}
+
+// Fills midinotes, midichannels and freqs with the notes retuned since sinceGeneration, each once, and sets
+// currentGeneration to pass as sinceGeneration next time. Returns -1 if the caller must treat every note as changed.
+MTS_EXPORT int MTS_GetTuningChanges(unsigned int sinceGeneration, unsigned int *currentGeneration, char *midinotes, signed char *midichannels, double *freqs, int maxChanges)
+{
+    return MTS_Slot_GetTuningChanges(0, sinceGeneration, currentGeneration, midinotes, midichannels, freqs, maxChanges);
+}
+
+// Fills offsets, midinotes, midichannels and freqs with the changes scheduled within a block, in time order.
+MTS_EXPORT int MTS_GetScheduledTuningChanges(double blockStart, int blockLength, int *offsets, char *midinotes, signed char *midichannels, double *freqs, int maxChanges)
+{
+    return MTS_Slot_GetScheduledTuningChanges(0, blockStart, blockLength, offsets, midinotes, midichannels, freqs, maxChanges);
+}
+
+// Without a MIDI channel, notes filtered on any channel are filtered.
+MTS_EXPORT bool MTS_ShouldFilterNote(char midinote, signed char midichannel)
+{
+    return MTS_Slot_ShouldFilterNote(0, midinote, midichannel);
+}
+
+MTS_EXPORT bool MTS_ShouldFilterNoteMultiChannel(char midinote, signed char midichannel)
+{
+    return MTS_Slot_ShouldFilterNoteMultiChannel(0, midinote, midichannel);
+}
+
+MTS_EXPORT const double *MTS_GetMultiChannelTuningTable(signed char midichannel)
+{
+    return MTS_Slot_GetMultiChannelTuningTable(0, midichannel);
+}
+
+MTS_EXPORT const double *MTS_GetMultiChannelTuningTables()
+{
+    return MTS_Slot_GetMultiChannelTuningTables(0);
+}
+
+MTS_EXPORT bool MTS_UseMultiChannelTuning(signed char midichannel)
+{
+    return MTS_Slot_UseMultiChannelTuning(0, midichannel);
+}